@@ -78,6 +78,15 @@ struct PEOptHeader
 	DataDirectory data_directory[16];
 };
 
+struct ImportDescriptor
+{
+	uint32_t originalFirstThunk; // RVA of the import lookup table
+	uint32_t timeDateStamp;
+	uint32_t forwarderChain;
+	uint32_t name; // RVA of the DLL name
+	uint32_t firstThunk; // RVA of the import address table
+};
+
 struct SectionHeader
 {
 	char name[8];
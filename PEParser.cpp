@@ -1,14 +1,35 @@
 #include "PEParser.h"
 
-#include <locale>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
 #include <ranges>
 #include <span>
+#include <stdexcept>
+
+#include "checksum.h"
 
 PEParser::PEParser(uint8_t* data, size_t& data_size) :
     // Initialize member variables
     data(data), dataSize(data_size), virtualImage{},
 	virtualImageSize{},
-	coffHeader{}, peHeader{}
+	coffHeaderOffset{}, peHeaderOffset{}, sectionTableOffset{}
+{
+    Parse();
+}
+
+PEParser::PEParser(const std::string& path) :
+    // Map the file copy-on-write and parse it in place, without reading it into a buffer first
+    mappedFile(std::make_unique<MappedFile>(path)),
+    data(mappedFile->GetData()), dataSize(mappedFile->GetSize()), virtualImage{},
+	virtualImageSize{},
+	coffHeaderOffset{}, peHeaderOffset{}, sectionTableOffset{}
+{
+    Parse();
+}
+
+void PEParser::Parse()
 {
     // Check if the data size is smaller than the size of the DOSHeader
     if (dataSize < sizeof(DOSHeader))
@@ -32,7 +53,7 @@ PEParser::PEParser(uint8_t* data, size_t& data_size) :
         throw std::runtime_error("Wrong PE signature.");
 
     // Get the COFF header
-    coffHeader = reinterpret_cast<COFFHeader*>(PEMAGIC + 4);
+    const auto* coffHeader = reinterpret_cast<COFFHeader*>(PEMAGIC + 4);
 
     // Check if the machine type is i386
     if (coffHeader->machine != 0x14C) // i386
@@ -51,7 +72,7 @@ PEParser::PEParser(uint8_t* data, size_t& data_size) :
         throw std::runtime_error("Not an executable or a DLL.");
 
     // Get the PE optional header
-    peHeader = reinterpret_cast<PEOptHeader*>(reinterpret_cast<char*>(coffHeader) + sizeof(COFFHeader));
+    const auto* peHeader = reinterpret_cast<const PEOptHeader*>(reinterpret_cast<const char*>(coffHeader) + sizeof(COFFHeader));
 
     // Check if the optional PE header signature is correct
     if (peHeader->signature != 0x10B)
@@ -61,13 +82,75 @@ PEParser::PEParser(uint8_t* data, size_t& data_size) :
     if (peHeader->subsystem != 2 && peHeader->subsystem != 3)
         throw std::runtime_error("Subsystem is not a console nor a GUI");
 
-    // TODO: Load section headers
+    // Load section headers
+    const size_t section_table_offset = reinterpret_cast<const uint8_t*>(peHeader) - data + coffHeader->sizeOfOptionalHeader;
+    const size_t number_of_sections = static_cast<uint16_t>(coffHeader->numberOfSections);
+    if (dataSize < section_table_offset + number_of_sections * sizeof(SectionHeader))
+        throw std::runtime_error("Section table out of bounds.");
+    if (peHeader->sizeOfHeaders > dataSize || peHeader->sizeOfHeaders < section_table_offset + number_of_sections * sizeof(SectionHeader))
+        throw std::runtime_error("Invalid size of headers.");
+    const auto* raw_sections = reinterpret_cast<const SectionHeader*>(data + section_table_offset);
+
+    // Compute size of virtual image, trusting the header unless the headers or a section reach past it
+    virtualImageSize = std::max<size_t>(peHeader->sizeOfImage, peHeader->sizeOfHeaders);
+    for (const SectionHeader& h : std::span{ raw_sections, number_of_sections })
+        virtualImageSize = std::max<size_t>(virtualImageSize, static_cast<size_t>(h.virtualAddress) + std::max(h.virtualSize, h.rawDataSize));
+
+    // Load virtual image in a single arena; pages past the raw data of each section are never
+    // touched, so uninitialized data is zero-filled by the OS on first access
+    virtualArena = ImageArena(virtualImageSize, virtualImageSize >= LargeImageSize);
+    virtualImage = virtualArena.GetData();
+    std::copy_n(data, peHeader->sizeOfHeaders, virtualImage);
+    for (const SectionHeader& h : std::span{ raw_sections, number_of_sections }) {
+        // Only copy what is both in the file and inside the section
+        size_t copy_size = h.virtualSize ? std::min(h.virtualSize, h.rawDataSize) : h.rawDataSize;
+        if (h.rawDataOffset >= dataSize)
+            copy_size = 0;
+        copy_size = std::min<size_t>(copy_size, dataSize - std::min<size_t>(h.rawDataOffset, dataSize));
+        std::copy_n(data + h.rawDataOffset, copy_size, virtualImage + h.virtualAddress);
+    }
 
-    // TODO: Compute size of virtual image
+    // Nothing has been modified yet
+    dirtyPages.Resize(virtualImageSize);
+    dirtyData.Resize(dataSize);
 
-    // TODO: Load virtual image
+    // Decode the base relocations once, so fixups can be looked up in constant time
+    if (peHeader->numberOfRVAandSizes > IMAGE_DIRECTORY_ENTRY_BASERELOC) {
+        const DataDirectory& directory = peHeader->data_directory[IMAGE_DIRECTORY_ENTRY_BASERELOC];
+        if (directory.VirtualAddress && directory.size)
+            relocations = RelocationTable(virtualImage, virtualImageSize, directory.VirtualAddress, directory.size);
+    }
+
+    // Index the IAT slots, so indirect calls through them can be classified as external
+    if (peHeader->numberOfRVAandSizes > IMAGE_DIRECTORY_ENTRY_IMPORT) {
+        const DataDirectory& directory = peHeader->data_directory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+        if (directory.VirtualAddress && directory.size)
+            imports = ImportTable(virtualImage, virtualImageSize, directory.VirtualAddress, directory.size);
+    }
+
+    // Remember where the headers live; they are always reached through the current image
+    coffHeaderOffset = reinterpret_cast<const uint8_t*>(coffHeader) - data;
+    peHeaderOffset = reinterpret_cast<const uint8_t*>(peHeader) - data;
+    sectionTableOffset = section_table_offset;
 
-    // TODO: Rebase our various pointers on the virtual image
+    // Build the lookup tables over the section headers
+    IndexSections();
+}
+
+COFFHeader* PEParser::GetCOFFHeader() const
+{
+    return reinterpret_cast<COFFHeader*>(virtualImage + coffHeaderOffset);
+}
+
+PEOptHeader* PEParser::GetPEHeader() const
+{
+    return reinterpret_cast<PEOptHeader*>(virtualImage + peHeaderOffset);
+}
+
+std::span<SectionHeader> PEParser::GetSectionHeaders() const
+{
+    return { reinterpret_cast<SectionHeader*>(virtualImage + sectionTableOffset),
+        static_cast<uint16_t>(GetCOFFHeader()->numberOfSections) };
 }
 
 std::vector< std::string > PEParser::GetSectionNames() const 
@@ -76,189 +159,332 @@ std::vector< std::string > PEParser::GetSectionNames() const
     std::vector<std::string> names;
     
     // Reserve space in the vector for the number of section headers
-    names.reserve(sectionHeaders.size());
+    names.reserve(GetSectionHeaders().size());
     
-    // Loop over each section header
-    for( const auto section : sectionHeaders)
-    {
-        // Create a string with the name of the section (limited to 8 characters)
-        std::string name(section->name, 8);
-        
-        // Erase any whitespace characters in the name
-        name.erase(std::ranges::find_if( name, [](const char& a) -> bool
-        {
-            // Check if the character is a whitespace
-            if (std::isspace<char>(a, std::locale())) 
-                return true;
-        }), end(name));
-        
-        // Assign the cleaned name back to the 'name' variable
-        name = std::string( name );
-        
-        // Add the name to the vector of names
-        names.push_back(name);
-    }
+    // The names are already trimmed by the section views
+    for (const auto& [name, header] : GetSections())
+        names.emplace_back(name);
     
     // Return the vector of names
     return names;
 }
 
-uint32_t PEParser::GetEntryPoint() const {
-    // Get the address of the entry point from the PE header
-    const unsigned long entry = peHeader->addrOfEntryPoint;
+bool PEParser::HasSection(std::string_view section_name) const
+{
+    return sectionIndex.contains(GetSectionKey(section_name));
+}
+
+std::string_view PEParser::GetSectionName(const SectionHeader* header)
+{
+    // The name is NUL padded and isn't terminated when it is exactly 8 characters long
+    size_t length = 0;
+    while (length < sizeof(header->name) && header->name[length] != '\0')
+        length++;
+
+    // Drop any trailing whitespace some linkers pad the name with
+    while (length > 0 && (header->name[length - 1] == ' ' || header->name[length - 1] == '\t'))
+        length--;
+
+    return { header->name, length };
+}
 
-    // Iterate over all section headers
-    for( const SectionHeader * header : sectionHeaders) {
-        // Get the virtual address of the current section header
-        const unsigned long start = header->virtualAddress;
+uint64_t PEParser::GetSectionKey(std::string_view section_name)
+{
+    // Names longer than 8 characters can't be stored in a section header, so they never match
+    if (section_name.size() > sizeof(SectionHeader::name))
+        return UINT64_MAX;
+
+    // Pack the name into a zero padded 64-bit key
+    uint64_t key = 0;
+    std::memcpy(&key, section_name.data(), section_name.size());
+    return key;
+}
+
+void PEParser::IndexSections()
+{
+    const std::span<SectionHeader> headers = GetSectionHeaders();
+
+    sectionIndex.clear();
+    sectionIndex.reserve(headers.size());
+    sectionIntervals.clear();
+    sectionPages.clear();
+    codeBounds.clear();
+
+    if (headers.size() >= SharedPage)
+        throw std::runtime_error("Too many sections.");
+
+    for (size_t i = 0; i < headers.size(); i++) {
+        const SectionHeader* header = &headers[i];
+
+        // Map each section name to the first header carrying it
+        sectionIndex.emplace(GetSectionKey(GetSectionName(header)), i);
+
+        // Skip empty sections, they can't contain any address
+        const uint32_t start = header->virtualAddress;
+        const uint32_t end = start + header->virtualSize;
+        if (end <= start)
+            continue;
+        sectionIntervals.push_back({ start, end, static_cast<uint16_t>(i) });
 
-        // Check if the entry point lies within the current section
-        if ( const unsigned long limit = start + header->virtualSize; entry >= start && entry < limit)
-            // If it does, return the entry point
-            return entry;
+        // Check if the section is executable
+        if (header->characteristics & IMAGE_SCN_MEM_EXECUTE)
+            codeBounds.emplace_back(start, end);
+
+        // Mark every page the section touches
+        const size_t last_page = (static_cast<size_t>(end) - 1) >> PageShift;
+        if (sectionPages.size() <= last_page)
+            sectionPages.resize(last_page + 1, NoSection);
+        for (size_t page = start >> PageShift; page <= last_page; page++)
+            sectionPages[page] = sectionPages[page] == NoSection ? static_cast<uint16_t>(i) : SharedPage;
     }
 
-    // If the entry point is not found within any section, throw an error
-    throw std::runtime_error("Can't find the section containing the entry point. Maybe packed?");
+    // Sort the intervals so pages shared by several sections can be binary searched
+    std::ranges::sort(sectionIntervals, {}, &SectionInterval::start);
+}
+
+SectionHeader* PEParser::FindSection(std::string_view section_name) const
+{
+    // Look the packed name up in the index built at parse time
+    const auto it = sectionIndex.find(GetSectionKey(section_name));
+
+    // If the section header is not found, throw an invalid_argument exception
+    if (it == sectionIndex.end())
+        throw std::invalid_argument("Section doesn't exist");
+
+    return &GetSectionHeaders()[it->second];
+}
+
+uint32_t PEParser::GetEntryPoint() const {
+    // Get the address of the entry point from the PE header
+    const uint32_t entry = GetPEHeader()->addrOfEntryPoint;
+
+    // Check that the entry point lies within a section
+    if (!SectionOf(entry))
+        throw std::runtime_error("Can't find the section containing the entry point. Maybe packed?");
+
+    return entry;
 }
 uint32_t PEParser::GetRelativeEntryPoint() const {
     // The entry point of the PE file
-    const DWORD entry = peHeader->addrOfEntryPoint;
+    const uint32_t entry = GetPEHeader()->addrOfEntryPoint;
 
-    // Loop through each section header
-    for (const SectionHeader* h : sectionHeaders) {
-        // The start of the section in virtual memory
-        const DWORD start = h->virtualAddress;
-
-        // The end of the section in virtual memory
-        const DWORD limit = start + h->virtualSize;
-
-        // If the entry point is within this section
-        if (entry >= start && entry < limit) {
-            // Return the physical address of the entry point
-            // This is done by subtracting the virtual address of the section from the entry point
-            return entry - h->virtualAddress;
-        }
+    // Find the section containing the entry point
+    const SectionHeader* header = SectionOf(entry);
+    if (!header)
+        throw std::runtime_error("Can't find the section containing the entry point.");
+
+    // Return the offset of the entry point in its section
+    return entry - header->virtualAddress;
+}
+
+SectionHeader* PEParser::SectionOf(uint32_t rva) const {
+    // Addresses past the last section can't belong to any section
+    const size_t page = rva >> PageShift;
+    if (page >= sectionPages.size() || sectionPages[page] == NoSection)
+        return nullptr;
+
+    // Most pages are covered by a single section
+    if (const uint16_t index = sectionPages[page]; index != SharedPage) {
+        SectionHeader* header = &GetSectionHeaders()[index];
+        if (rva >= header->virtualAddress && rva < header->virtualAddress + header->virtualSize)
+            return header;
+        return nullptr;
     }
-    // If no section containing the entry point was found, throw an error
-    throw std::runtime_error("Can't find the section containing the entry point.");
+
+    // Otherwise find the last interval starting at or before the address
+    const auto it = std::ranges::upper_bound(sectionIntervals, rva, {}, &SectionInterval::start);
+    if (it == sectionIntervals.begin())
+        return nullptr;
+    const SectionInterval& interval = *std::prev(it);
+    return rva < interval.end ? &GetSectionHeaders()[interval.index] : nullptr;
 }
 
-uint32_t PEParser::GetSectionRawAddress( const std::string& section_name ) {
-    // Use the find_if algorithm from the ranges library to find the section header with the given name
-    // The lambda function compares the name of each section header with the provided section name
-    const auto it = std::ranges::find_if( sectionHeaders, [section_name]( const SectionHeader* header) {
-        return std::string( std::string( header->name, 8 ) ) == section_name;
-    });
+bool PEParser::IsExecutable(uint32_t rva) const {
+    const SectionHeader* header = SectionOf(rva);
+    return header && header->characteristics & IMAGE_SCN_MEM_EXECUTE;
+}
 
-    // If the section header is not found, throw an invalid_argument exception
-    if (it == end(sectionHeaders))
-        throw std::invalid_argument("Section doesn't exist");
+std::optional<uint32_t> PEParser::RvaToFileOffset(uint32_t rva) const {
+    const SectionHeader* header = SectionOf(rva);
+
+    // The headers are mapped at the same offset they have in the file
+    if (!header)
+        return rva < GetPEHeader()->sizeOfHeaders ? std::optional<uint32_t>{ rva } : std::nullopt;
 
-    // If the section header is found, return the raw data offset of the section
-    return (*it)->rawDataOffset;
+    // Uninitialized data past the raw size of the section has no file backing
+    const uint32_t offset = rva - header->virtualAddress;
+    if (offset >= header->rawDataSize)
+        return std::nullopt;
+
+    return header->rawDataOffset + offset;
 }
 
-uint32_t PEParser::GetSectionVirtualSize( const std::string& section_name )
-{
-    // Use the find_if algorithm from the ranges library to find the section with the given name
-    // The lambda function checks if the name of the current section header matches the given section name
-    const auto it = std::ranges::find_if(sectionHeaders, [section_name](const SectionHeader* header) {
-        return std::string(std::string(header->name, 8)) == section_name;
-        });
+uint32_t PEParser::GetSectionRawAddress(std::string_view section_name) {
+    // Return the raw data offset of the section
+    return FindSection(section_name)->rawDataOffset;
+}
 
-    // If the section with the given name is not found, throw an invalid_argument exception
-    if (it == end(sectionHeaders))
-        throw std::invalid_argument("Section doesn't exist");
+size_t PEParser::GetSectionRawSize(std::string_view section_name) {
+    // Return the raw data size of the section
+    return FindSection(section_name)->rawDataSize;
+}
+
+size_t PEParser::GetSectionVirtualAddress(std::string_view section_name) {
+    // Return the virtual address of the section
+    return FindSection(section_name)->virtualAddress;
+}
 
-    // If the section is found, return its virtual size
-    return (*it)->virtualSize;
+uint32_t PEParser::GetSectionVirtualSize(std::string_view section_name)
+{
+    // Return the virtual size of the section
+    return FindSection(section_name)->virtualSize;
+}
+
+std::pair<uint8_t*, size_t> PEParser::GetSectionData(std::string_view section_name) {
+    // Return the section as it is laid out in the virtual image
+    const SectionHeader* header = FindSection(section_name);
+    return { virtualImage + header->virtualAddress, header->virtualSize };
 }
 
 uint8_t*& PEParser::GetVirtualImage() {
     return virtualImage;
 }
 
-std::pair<uint32_t, uint32_t> PEParser::GetSectionVirtualBounds(const std::string& section_name) {
-    // Use the C++20 ranges library to find the section with the given name
-    const auto it = std::ranges::find_if(sectionHeaders, [&section_name](const SectionHeader* header) {
-        // Compare the name of the section with the given name
-        return std::string(header->name, 8) == section_name;
-        });
-
-    // If the section was not found, throw an exception
-    if (it == std::end(sectionHeaders))
-        throw std::invalid_argument("Section doesn't exist");
+std::pair<uint32_t, uint32_t> PEParser::GetSectionVirtualBounds(std::string_view section_name) {
+    const SectionHeader* header = FindSection(section_name);
 
     // Get the start and end of the section in virtual memory
-    auto start = (*it)->virtualAddress;
-    auto end = start + (*it)->virtualSize;
+    auto start = header->virtualAddress;
+    auto end = start + header->virtualSize;
 
     // Return the start and end as a pair
     return { start, end };
 }
 
 uint32_t PEParser::GetImageBase() const {
-    return peHeader->imageBase;
+    return GetPEHeader()->imageBase;
 }
 
 uint32_t PEParser::GetCodeBase() {
-    return peHeader->baseOfCode;
+    return GetPEHeader()->baseOfCode;
 }
 
-std::vector< std::pair< uint32_t, uint32_t > > PEParser::GetCodeSectionsVirtualBounds() {
-    // Vector to store the virtual bounds of the code sections
-    std::vector<std::pair<uint32_t, uint32_t>> bounds;
+const std::vector< std::pair< uint32_t, uint32_t > >& PEParser::GetCodeSectionsVirtualBounds() const {
+    // If no code section was found, throw an exception
+    if (codeBounds.empty())
+        throw std::runtime_error("No code section found.");
+
+    // Return the virtual bounds collected when the sections were indexed
+    return codeBounds;
+}
+
+void PEParser::UpdateDataFromVirtualImage() {
+    // Copy the modified parts of the headers back
+    dirtyPages.ForEachExtent(0, std::min<size_t>(GetPEHeader()->sizeOfHeaders, dataSize), [this](size_t start, size_t end) {
+        std::copy(virtualImage + start, virtualImage + end, data + start);
+        dirtyData.Mark(start, end - start);
+    });
 
     // Loop through each section header
-    for (const SectionHeader* h : sectionHeaders) {
-        // Check if the section is executable
-        if (h->characteristics & IMAGE_SCN_MEM_EXECUTE) {
-            // Get the start and end of the section in virtual memory
-            auto start = h->virtualAddress;
-            auto end = start + h->virtualSize;
-
-            // Add the virtual bounds to the vector
-            bounds.emplace_back( start, end );
-        }
+    for (const SectionHeader& h : GetSectionHeaders()) {
+        // Only the part of the section backed by raw data has somewhere to go, clipped to the file as Parse() does
+        const size_t start = h.virtualAddress;
+        const size_t size = h.virtualSize ? std::min(h.virtualSize, h.rawDataSize) : h.rawDataSize;
+        const size_t end = start + std::min<size_t>(size, dataSize - std::min<size_t>(h.rawDataOffset, dataSize));
+
+        // Copy the modified extents of the section back to their file offsets
+        dirtyPages.ForEachExtent(start, end, [this, &h](size_t extent_start, size_t extent_end) {
+            const size_t raw_offset = h.rawDataOffset + (extent_start - h.virtualAddress);
+            std::copy(virtualImage + extent_start, virtualImage + extent_end, data + raw_offset);
+            dirtyData.Mark(raw_offset, extent_end - extent_start);
+        });
     }
 
-    // If no code section was found, throw an exception
-    if (bounds.empty())
-        throw std::runtime_error("No code section found.");
+    // The raw data is now in sync with the virtual image
+    dirtyPages.Clear();
+}
 
-    // Return the vector of virtual bounds
-    return bounds;
+void PEParser::FinalizeHeaders() {
+    PEOptHeader* peHeader = GetPEHeader();
+    const auto align = [](uint32_t value, uint32_t alignment) {
+        return alignment ? (value + alignment - 1) / alignment * alignment : value;
+    };
+
+    // Recompute the size fields from the section table in a single pass
+    uint32_t image_end = peHeader->sizeOfHeaders;
+    uint32_t code = 0, initialized = 0, uninitialized = 0;
+    for (const SectionHeader& h : GetSectionHeaders()) {
+        image_end = std::max(image_end, h.virtualAddress + std::max(h.virtualSize, h.rawDataSize));
+        if (h.characteristics & IMAGE_SCN_CNT_CODE)
+            code += align(h.rawDataSize, peHeader->fileAlignment);
+        if (h.characteristics & IMAGE_SCN_CNT_INITIALIZED_DATA)
+            initialized += align(h.rawDataSize, peHeader->fileAlignment);
+        if (h.characteristics & IMAGE_SCN_CNT_UNINITIALIZED_DATA)
+            uninitialized += align(h.virtualSize, peHeader->fileAlignment);
+    }
+    peHeader->sizeOfImage = align(image_end, peHeader->sectionAlignment);
+    peHeader->sizeOfCode = code;
+    peHeader->sizeOfInitializedData = initialized;
+    peHeader->sizeOfUninitializedData = uninitialized;
+    MarkDirty(static_cast<uint32_t>(peHeaderOffset), sizeof(PEOptHeader));
+
+    // Bring the raw data up to date with the virtual image
+    UpdateDataFromVirtualImage();
+
+    // Checksum the final file layout and store the result in both copies of the header
+    const size_t checksum_offset = peHeaderOffset + offsetof(PEOptHeader, checksum);
+    const uint32_t checksum = ComputePEChecksum(data, dataSize, checksum_offset);
+    peHeader->checksum = checksum;
+    std::memcpy(data + checksum_offset, &checksum, sizeof(checksum));
+    dirtyData.Mark(checksum_offset, sizeof(checksum));
 }
 
-void PEParser::UpdateDataFromVirtualImage() const {
-    // Loop through each section header
-    for ( const SectionHeader* h : sectionHeaders) {
-        // Check if the section is writable
-        if (h->characteristics & IMAGE_SCN_MEM_WRITE) {
-            // Get the start and end of the section in virtual memory
-            const auto start = h->virtualAddress;
-            const auto end = start + h->virtualSize;
-
-            // Get the raw data pointer and size
-            const auto raw_data_ptr = h->rawDataOffset;
-            const auto raw_data_size = h->rawDataSize;
-
-            // Copy the headers back
-            std::copy(reinterpret_cast<uint8_t*>(start),
-                reinterpret_cast<uint8_t*>(end),
-                reinterpret_cast<uint8_t*>(raw_data_ptr));
-
-            // Copy the sections back
-            std::copy(reinterpret_cast<uint8_t*>(raw_data_ptr),
-                reinterpret_cast<uint8_t*>(raw_data_ptr + raw_data_size),
-                reinterpret_cast<uint8_t*>(start));
-        }
+void PEParser::Write(const std::string& path) {
+    // Reconcile the headers and bring the raw data up to date with the virtual image
+    FinalizeHeaders();
+
+    // Without the original file on disk, every byte has to be written
+    if (!mappedFile) {
+        const OutputFile output(path, dataSize, false);
+        std::copy_n(data, dataSize, output.GetData());
+        return;
     }
+
+    // Let the file system copy the input: CopyFile is handled in the kernel and clones
+    // the extents on file systems with block cloning (ReFS, Dev Drive)
+    if (!CopyFileA(mappedFile->GetPath().c_str(), path.c_str(), FALSE))
+        throw std::runtime_error("Could not copy the input file to the output file.");
+
+    // Resize the copy to the final layout and only write the bytes that changed;
+    // data appended by AddSection or ExpandLastSectionBy is zero unless it is dirty
+    const OutputFile output(path, dataSize, true);
+    dirtyData.ForEachExtent(0, dataSize, [this, &output](size_t start, size_t end) {
+        std::copy(data + start, data + end, output.GetData() + start);
+    });
+}
+
+void PEParser::MarkDirty(uint32_t rva, size_t size) {
+    dirtyPages.Mark(rva, size);
 }
 
-void PEParser::SetEntryPoint( uint32_t value ) const {
-    peHeader->addrOfEntryPoint = value;
+void PEParser::SetEntryPoint( uint32_t value ) {
+    GetPEHeader()->addrOfEntryPoint = value;
+    MarkDirty(static_cast<uint32_t>(peHeaderOffset), sizeof(PEOptHeader));
+}
+
+const RelocationTable& PEParser::GetRelocations() const
+{
+    return relocations;
+}
+
+bool PEParser::IsRelocated(uint32_t rva, size_t size) const
+{
+    return relocations.IsRelocated(rva, size);
+}
+
+const ImportTable& PEParser::GetImports() const
+{
+    return imports;
 }
 
 std::pair< uint8_t*, size_t > PEParser::GetData() const
@@ -269,6 +495,8 @@ std::pair< uint8_t*, size_t > PEParser::GetData() const
 
 uint32_t PEParser::AddSection( const std::string& name, size_t size, uint32_t flags )
 {
+    PEOptHeader* peHeader = GetPEHeader();
+
     // Align the start of the raw data to the file alignment boundary
     uint32_t aligned_raw_start = dataSize;
     if (aligned_raw_start % peHeader->fileAlignment)
@@ -284,27 +512,18 @@ uint32_t PEParser::AddSection( const std::string& name, size_t size, uint32_t fl
     uint32_t aligned_virtual_end = aligned_virtual_start + size;
 
     // Check if there is enough room for the new section header
-    size_t new_headers = reinterpret_cast< uint8_t* >( sectionHeaders.back() + 2 ) - virtualImage;
-    if (new_headers >= sectionHeaders[0]->rawDataOffset)
+    const std::span<SectionHeader> headers = GetSectionHeaders();
+    const size_t new_headers = sectionTableOffset + (headers.size() + 1) * sizeof(SectionHeader);
+    if (headers.empty() || new_headers > headers.front().rawDataOffset || new_headers > peHeader->sizeOfHeaders)
         throw std::runtime_error("There is not enough room for the new section header.");
 
-    // Save the old image address before reallocating memory
-    uint8_t* old_image_address = virtualImage;
-
-    // Reallocate memory for the raw and virtual data
-    data = static_cast<uint8_t*>(realloc(data, aligned_raw_end));
-    virtualImage = static_cast<uint8_t*>(realloc(virtualImage, aligned_virtual_end));
-
-    // Update the section headers, COFF header, and PE optional header to the new memory location
-    for ( auto & section_header : sectionHeaders )
-	    section_header = reinterpret_cast< SectionHeader* >( reinterpret_cast< uint32_t >( section_header ) 
-																- reinterpret_cast< uint32_t >( old_image_address )
-																	+ reinterpret_cast< uint32_t >( virtualImage ) );
-    coffHeader = reinterpret_cast< COFFHeader* >( reinterpret_cast< uint32_t >( coffHeader ) - reinterpret_cast< uint32_t >( old_image_address ) + reinterpret_cast< uint32_t >( virtualImage ) );
-    peHeader = reinterpret_cast< PEOptHeader* >( ( uint32_t )peHeader - ( uint32_t )old_image_address + ( uint32_t )virtualImage );
+    // Grow the raw and virtual data; the headers are reached by offset, so nothing needs rebasing
+    GrowData(aligned_raw_end);
+    virtualArena.Resize(aligned_virtual_end);
+    virtualImage = virtualArena.GetData();
 
     // Create the section header for the new section
-    SectionHeader* new_header = sectionHeaders.back() + 1;
+    auto* new_header = reinterpret_cast<SectionHeader*>(virtualImage + new_headers) - 1;
     new_header->characteristics = flags;
     new_header->lineNumbersOffsets = NULL;
     strncpy(new_header->name, name.c_str(), 8);
@@ -316,82 +535,64 @@ uint32_t PEParser::AddSection( const std::string& name, size_t size, uint32_t fl
     new_header->virtualAddress = aligned_virtual_start;
     new_header->virtualSize = size;
 
-    // Update the metadata in the COFF header and PE optional header
-    coffHeader->numberOfSections++;
-    peHeader->sizeOfImage += aligned_virtual_end - aligned_virtual_start;
-    if(flags & IIMAGE_SCN_CNT_CODE)
-    {
-        peHeader->sizeOfCode += aligned_virtual_end - aligned_virtual_start;
-        peHeader->sizeOfInitializedData += aligned_virtual_end - aligned_virtual_start;
-    }
+    // Update the section count; the size fields are reconciled by FinalizeHeaders
+    GetCOFFHeader()->numberOfSections++;
 
     // Update the size of the raw and virtual data
     dataSize = aligned_raw_end;
     virtualImageSize = aligned_virtual_end;
 
+    // The headers changed; the new section is dirty only once something is written to it
+    MarkDirty(0, new_headers);
+    IndexSections();
+
     // Return the virtual address of the new section
-    return (uint32_t)new_header->virtualAddress;
+    return new_header->virtualAddress;
 }
 
 // Expand the last section of the PE file by the given size
-// Use std::vector and std::span from C++20 instead of raw pointers
 void PEParser::ExpandLastSectionBy(size_t size) {
+    // Grow the raw and virtual data in place
+    GrowData(dataSize + size);
+    virtualArena.Resize(virtualImageSize + size);
+    virtualImage = virtualArena.GetData();
 
-    // Get span to original image
-    std::span<uint8_t> originalImage{ virtualImage, virtualImageSize };
-
-
-    data = (uint8_t*)std::realloc(data, dataSize + size);
-
-    // Reallocate virtual image buffer
-    virtualImage = (uint8_t*)std::realloc(virtualImage, virtualImageSize + size);
-
-    // Update section headers to point to new virtual image location
-    for (auto& sectionHeader : sectionHeaders) {
-        sectionHeader = reinterpret_cast<SectionHeader*>(
-            reinterpret_cast<uintptr_t>(sectionHeader) -
-            reinterpret_cast<uintptr_t>(originalImage.data()) +
-            reinterpret_cast<uintptr_t>(virtualImage));
-    }
-
-    // Update COFF and PE headers
-    coffHeader = reinterpret_cast<COFFHeader*>(
-        reinterpret_cast<uintptr_t>(coffHeader) -
-        reinterpret_cast<uintptr_t>(originalImage.data()) +
-        reinterpret_cast<uintptr_t>(virtualImage));
-
-    peHeader = reinterpret_cast<PEOptHeader*>(
-        reinterpret_cast<uintptr_t>(peHeader) -
-        reinterpret_cast<uintptr_t>(originalImage.data()) +
-        reinterpret_cast<uintptr_t>(virtualImage));
-
-    // Get last section header
-    const auto& header = sectionHeaders.back();
-
-    // Update sizes
-    header->rawDataSize += size;
-    header->virtualSize += size;
-    peHeader->sizeOfImage += size;
-
-    if (header->characteristics & IMAGE_SCN_CNT_CODE) {
-        peHeader->sizeOfCode += size;
-        peHeader->sizeOfInitializedData += size;
-    }
+    // Update the sizes of the last section; the size fields are reconciled by FinalizeHeaders
+    SectionHeader& header = GetSectionHeaders().back();
+    header.rawDataSize += size;
+    header.virtualSize += size;
 
     // Update data sizes
     dataSize += size;
     virtualImageSize += size;
+    MarkDirty(0, GetPEHeader()->sizeOfHeaders);
+
+    // The last section now covers more pages
+    IndexSections();
 }
 
 bool PEParser::IsLastSectionRECode() const {
-    const SectionHeader* header = sectionHeaders.back();
-    if ( constexpr uint32_t flags = IMAGE_SCN_CNT_CODE | IMAGE_SCN_MEM_READ_EXECUTE; (header->characteristics & flags) == flags)
+    const SectionHeader& header = GetSectionHeaders().back();
+    if ( constexpr uint32_t flags = IMAGE_SCN_CNT_CODE | IMAGE_SCN_MEM_READ_EXECUTE; (header.characteristics & flags) == flags)
         return true;
     return false;
 }
 
 uint32_t PEParser::GetLastSectionEnd() const {
-	const SectionHeader* header = sectionHeaders.back();
-    return header->virtualAddress + header->virtualSize;
+	const SectionHeader& header = GetSectionHeaders().back();
+    return header.virtualAddress + header.virtualSize;
 }
 
+void PEParser::GrowData(size_t size)
+{
+    // The first time the raw data grows, move it out of the caller's buffer or the
+    // mapped view into an arena that can keep growing in place
+    if (data != rawArena.GetData())
+    {
+        rawArena = ImageArena(std::max(size, dataSize));
+        std::copy_n(data, dataSize, rawArena.GetData());
+    }
+
+    rawArena.Resize(size);
+    data = rawArena.GetData();
+}
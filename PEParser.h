@@ -5,50 +5,115 @@
 
 #include <cstdint>
 #include <memory>
+#include <optional>
+#include <ranges>
+#include <span>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "PEFormat.h"
+#include "dirty_tracker.h"
+#include "image_arena.h"
+#include "imports.h"
+#include "mapped_file.h"
 #include "relocation.h"
 
+// Non-owning view of a section header and its trimmed name.
+// Only valid until the next AddSection/ExpandLastSectionBy.
+struct SectionView
+{
+	std::string_view name;
+	SectionHeader* header;
+};
+
 class PEParser
 {
 public:
 	PEParser(uint8_t* data, size_t& data_size);
+	explicit PEParser(const std::string& path);
 	PEParser() = default;
 	~PEParser() = default;
 	void operator = (const PEParser&) = delete;
 
 	std::vector<std::string> GetSectionNames() const;
-	std::pair<uint8_t*, size_t> GetSectionData(const std::string& section_name);
-	size_t GetSectionRawSize(const std::string& section_name);
-	uint32_t GetSectionRawAddress(const std::string& section_name);
-	size_t GetSectionVirtualAddress(const std::string& section_name);
-	uint32_t GetSectionVirtualSize(const std::string& section_name);
+	auto GetSections() const
+	{
+		return GetSectionHeaders() | std::views::transform([](SectionHeader& header) {
+			return SectionView{ GetSectionName(&header), &header };
+		});
+	}
+	bool HasSection(std::string_view section_name) const;
+	std::pair<uint8_t*, size_t> GetSectionData(std::string_view section_name);
+	size_t GetSectionRawSize(std::string_view section_name);
+	uint32_t GetSectionRawAddress(std::string_view section_name);
+	size_t GetSectionVirtualAddress(std::string_view section_name);
+	uint32_t GetSectionVirtualSize(std::string_view section_name);
 	uint32_t GetEntryPoint() const;
 	uint32_t GetRelativeEntryPoint() const;
 	uint8_t*& GetVirtualImage();
-	std::pair<uint32_t, uint32_t> GetSectionVirtualBounds(const std::string& section_name);
-	std::vector<std::pair<uint32_t, uint32_t>> GetCodeSectionsVirtualBounds();
+	std::pair<uint32_t, uint32_t> GetSectionVirtualBounds(std::string_view section_name);
+	const std::vector<std::pair<uint32_t, uint32_t>>& GetCodeSectionsVirtualBounds() const;
+	SectionHeader* SectionOf(uint32_t rva) const;
+	bool IsExecutable(uint32_t rva) const;
+	std::optional<uint32_t> RvaToFileOffset(uint32_t rva) const;
 	uint32_t GetImageBase() const;
 	uint32_t GetCodeBase();
 	std::pair<uint8_t*, size_t> GetData() const;
-	void UpdateDataFromVirtualImage() const;
+	void UpdateDataFromVirtualImage();
+	void FinalizeHeaders();
+	void Write(const std::string& path);
+	void MarkDirty(uint32_t rva, size_t size);
 	uint32_t AddSection(const std::string& name, size_t size, uint32_t flags);
 	void ExpandLastSectionBy(size_t size);
-	void SetEntryPoint(uint32_t value) const;
+	void SetEntryPoint(uint32_t value);
 	bool IsLastSectionRECode() const;
 	uint32_t GetLastSectionEnd() const;
+	const RelocationTable& GetRelocations() const;
+	bool IsRelocated(uint32_t rva, size_t size = 1) const;
+	const ImportTable& GetImports() const;
 private:
+	void Parse();
+	void GrowData(size_t size);
+	COFFHeader* GetCOFFHeader() const;
+	PEOptHeader* GetPEHeader() const;
+	std::span<SectionHeader> GetSectionHeaders() const;
+	void IndexSections();
+	SectionHeader* FindSection(std::string_view section_name) const;
+	static std::string_view GetSectionName(const SectionHeader* header);
+	static uint64_t GetSectionKey(std::string_view section_name);
+
+	struct SectionInterval
+	{
+		uint32_t start;
+		uint32_t end;
+		uint16_t index;
+	};
+	static constexpr uint32_t PageShift = 12;
+	static constexpr size_t LargeImageSize = 0x4000000; // back images this big with large pages
+	static constexpr uint16_t NoSection = 0xFFFF;
+	static constexpr uint16_t SharedPage = 0xFFFE; // more than one section touches the page
+
+	std::unique_ptr<MappedFile> mappedFile;
 	uint8_t* data;
 	size_t& dataSize;
+	ImageArena virtualArena;
 	uint8_t* virtualImage;
 	size_t virtualImageSize;
-	COFFHeader* coffHeader;
-	PEOptHeader* peHeader;
-	std::vector<SectionHeader*> sectionHeaders;
-	std::vector<Relocation> relocations;
+	DirtyTracker dirtyPages; // pages of the virtual image written since the last write-back
+	DirtyTracker dirtyData; // pages of the raw data that differ from the input file
+	ImageArena rawArena; // holds the raw data once it has to grow
+	size_t coffHeaderOffset; // headers are stored as offsets into the virtual image
+	size_t peHeaderOffset;
+	size_t sectionTableOffset;
+	std::unordered_map<uint64_t, size_t> sectionIndex; // packed 8-byte name -> section index
+	std::vector<SectionInterval> sectionIntervals; // sorted by start
+	std::vector<uint16_t> sectionPages; // page of the image -> section index
+	std::vector<std::pair<uint32_t, uint32_t>> codeBounds;
+	RelocationTable relocations;
+	ImportTable imports;
 };
 
 #endif
@@ -0,0 +1,252 @@
+#include "block_graph.h"
+
+#include <algorithm>
+#include <utility>
+
+void BlockGraph::Reset(uint32_t start, uint32_t end)
+{
+    Clear();
+    index.Reset(start, end);
+}
+
+void BlockGraph::Clear()
+{
+    blocks.clear();
+    edges.clear();
+    unused = 0;
+    index.Reset(0, 0);
+}
+
+uint32_t BlockGraph::Allocate(std::span<const uint32_t> ids)
+{
+    const uint32_t first = static_cast<uint32_t>(edges.size());
+    edges.insert(edges.end(), ids.begin(), ids.end());
+    return first;
+}
+
+uint32_t BlockGraph::Reallocate(uint32_t first, uint32_t count, uint32_t id)
+{
+    const uint32_t moved = static_cast<uint32_t>(edges.size());
+    unused += count;
+    edges.reserve(edges.size() + count + 1);
+    for (uint32_t i = 0; i < count; i++)
+        edges.push_back(edges[first + i]);
+    edges.push_back(id);
+    return moved;
+}
+
+uint32_t BlockGraph::Add(uint32_t start, uint32_t end, std::span<const uint32_t> dest_addresses)
+{
+    // Until Link(), the successors are addresses
+    const uint32_t id = static_cast<uint32_t>(blocks.size());
+    blocks.push_back({ start, end, Allocate(dest_addresses), static_cast<uint32_t>(dest_addresses.size()), 0, 0 });
+    index.Add(start, end, id);
+    return id;
+}
+
+void BlockGraph::Link()
+{
+    // Resolve the destinations in place, dropping the ones outside every block
+    std::vector<uint32_t> counts(blocks.size() + 1);
+    for (Block& block : blocks) {
+        uint32_t* successors = edges.data() + block.first_successor;
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < block.successor_count; i++) {
+            const uint32_t id = index.Find(successors[i]);
+            if (id != NoBlock && std::find(successors, successors + count, id) == successors + count) {
+                successors[count++] = id;
+                counts[id + 1]++;
+            }
+        }
+        unused += block.successor_count - count;
+        block.successor_count = count;
+    }
+
+    // Predecessors are the successor edges bucketed by target, after all the successor lists
+    for (size_t i = 1; i < counts.size(); i++)
+        counts[i] += counts[i - 1];
+    const uint32_t base = static_cast<uint32_t>(edges.size());
+    edges.resize(edges.size() + counts.back());
+    for (uint32_t id = 0; id < blocks.size(); id++) {
+        blocks[id].first_predecessor = base + counts[id];
+        blocks[id].predecessor_count = counts[id + 1] - counts[id];
+    }
+    for (uint32_t id = 0; id < blocks.size(); id++)
+        for (const uint32_t successor : Successors(id))
+            edges[base + counts[successor]++] = id;
+}
+
+uint32_t BlockGraph::Insert(uint32_t start, uint32_t end)
+{
+    const uint32_t id = static_cast<uint32_t>(blocks.size());
+    const uint32_t first = static_cast<uint32_t>(edges.size());
+    blocks.push_back({ start, end, first, 0, first, 0 });
+    index.Insert(start, end, id);
+    return id;
+}
+
+void BlockGraph::Relink(uint32_t id, std::span<const uint32_t> dest_addresses)
+{
+    // The block leaves the predecessors of its old successors
+    for (const uint32_t successor : Successors(id)) {
+        Block& block = blocks[successor];
+        const auto first = edges.begin() + block.first_predecessor;
+        const uint32_t count = static_cast<uint32_t>(std::remove(first, first + block.predecessor_count, id) - first);
+        unused += block.predecessor_count - count;
+        block.predecessor_count = count;
+    }
+
+    std::vector<uint32_t> successors;
+    for (const uint32_t dest : dest_addresses) {
+        const uint32_t successor = index.Find(dest);
+        if (successor != NoBlock && std::ranges::find(successors, successor) == successors.end())
+            successors.push_back(successor);
+    }
+    unused += blocks[id].successor_count;
+    blocks[id].first_successor = Allocate(successors);
+    blocks[id].successor_count = static_cast<uint32_t>(successors.size());
+
+    // A predecessor list grows in place only if it is the last one of the arena
+    for (const uint32_t successor : successors) {
+        Block& block = blocks[successor];
+        if (block.first_predecessor + block.predecessor_count == edges.size())
+            edges.push_back(id);
+        else
+            block.first_predecessor = Reallocate(block.first_predecessor, block.predecessor_count, id);
+        block.predecessor_count++;
+    }
+
+    // Every relink leaves lists behind; once they are most of the arena, it is written again
+    if (unused > edges.size() / 2)
+        Compact();
+}
+
+void BlockGraph::Compact()
+{
+    std::vector<uint32_t> compacted;
+    compacted.reserve(edges.size() - unused);
+    const auto move = [&](uint32_t& first, uint32_t count) {
+        const uint32_t moved = static_cast<uint32_t>(compacted.size());
+        compacted.insert(compacted.end(), edges.begin() + first, edges.begin() + first + count);
+        first = moved;
+    };
+    for (Block& block : blocks) {
+        move(block.first_successor, block.successor_count);
+        move(block.first_predecessor, block.predecessor_count);
+    }
+    edges = std::move(compacted);
+    unused = 0;
+}
+
+uint32_t BlockGraph::Split(uint32_t addr)
+{
+    const uint32_t id = index.Find(addr);
+    if (id == NoBlock || blocks[id].start_address == addr)
+        return id;
+
+    // The second part takes over the successors, whose predecessor lists now name it
+    const uint32_t second = static_cast<uint32_t>(blocks.size());
+    const Block first = blocks[id];
+    blocks.push_back({ addr, first.end_address, first.first_successor, first.successor_count, Allocate({ &id, 1 }), 1 });
+    for (const uint32_t successor : Successors(second)) {
+        const Block& block = blocks[successor];
+        std::replace(edges.begin() + block.first_predecessor, edges.begin() + block.first_predecessor + block.predecessor_count, id, second);
+    }
+
+    // The first part only falls through into the second; its old list now belongs to the second
+    const uint32_t fall_through = Allocate({ &second, 1 });
+    blocks[id].end_address = addr;
+    blocks[id].first_successor = fall_through;
+    blocks[id].successor_count = 1;
+
+    index.Split(addr, second);
+    return second;
+}
+
+std::vector<uint32_t> BlockGraph::ReversePostOrder() const
+{
+    // Depth-first from the blocks nothing jumps to, then from whatever is left (loops only reached indirectly)
+    std::vector<uint32_t> order;
+    order.reserve(blocks.size());
+    std::vector<bool> visited(blocks.size());
+    std::vector<std::pair<uint32_t, uint32_t>> stack; // block and its next successor
+    const auto visit = [&](uint32_t root) {
+        if (visited[root])
+            return;
+        visited[root] = true;
+        stack.emplace_back(root, 0);
+        while (!stack.empty()) {
+            const auto [id, next] = stack.back();
+            const std::span<const uint32_t> successors = Successors(id);
+            if (next == successors.size()) {
+                order.push_back(id);
+                stack.pop_back();
+                continue;
+            }
+            stack.back().second++;
+            if (!visited[successors[next]]) {
+                visited[successors[next]] = true;
+                stack.emplace_back(successors[next], 0);
+            }
+        }
+    };
+    for (uint32_t id = 0; id < blocks.size(); id++)
+        if (Predecessors(id).empty())
+            visit(id);
+    for (uint32_t id = 0; id < blocks.size(); id++)
+        visit(id);
+    std::ranges::reverse(order);
+    return order;
+}
+
+std::vector<uint32_t> BlockGraph::Closure(std::span<const uint32_t> ids, bool forward) const
+{
+    // Breadth-first, so the blocks come out roughly in the order a dataflow pass wants them
+    std::vector<uint32_t> closure;
+    std::vector<bool> visited(blocks.size());
+    for (const uint32_t id : ids) {
+        if (!visited[id]) {
+            visited[id] = true;
+            closure.push_back(id);
+        }
+    }
+    for (size_t i = 0; i < closure.size(); i++) {
+        for (const uint32_t next : forward ? Successors(closure[i]) : Predecessors(closure[i])) {
+            if (!visited[next]) {
+                visited[next] = true;
+                closure.push_back(next);
+            }
+        }
+    }
+    return closure;
+}
+
+Block& BlockGraph::operator [] (uint32_t id)
+{
+    return blocks[id];
+}
+
+const Block& BlockGraph::operator [] (uint32_t id) const
+{
+    return blocks[id];
+}
+
+uint32_t BlockGraph::Find(uint32_t addr) const
+{
+    return index.Find(addr);
+}
+
+std::span<const uint32_t> BlockGraph::Successors(uint32_t id) const
+{
+    return { edges.data() + blocks[id].first_successor, blocks[id].successor_count };
+}
+
+std::span<const uint32_t> BlockGraph::Predecessors(uint32_t id) const
+{
+    return { edges.data() + blocks[id].first_predecessor, blocks[id].predecessor_count };
+}
+
+size_t BlockGraph::Size() const
+{
+    return blocks.size();
+}
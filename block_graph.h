@@ -0,0 +1,64 @@
+#pragma once
+
+#ifndef BLOCK_GRAPH_H
+#define BLOCK_GRAPH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "block_index.h"
+
+// A basic block; its edges live in the BlockGraph that owns it
+struct Block
+{
+	uint32_t start_address;
+	uint32_t end_address; // exclusive
+	uint32_t first_successor; // into the graph's edge arena
+	uint32_t successor_count;
+	uint32_t first_predecessor;
+	uint32_t predecessor_count;
+};
+
+// Control flow graph of one analysis. Blocks are plain records indexed by id and
+// every edge list is a run of block ids in a single arena, so the whole graph is
+// a few allocations, released together by Clear() or with the graph.
+// Blocks are added in address order with the addresses they go to; Link() then
+// turns those addresses into successor ids and fills in the predecessors.
+// Once linked, blocks can be inserted anywhere and relinked one at a time; edge
+// lists that change are written again at the end of the arena, and the arena is
+// compacted once the lists left behind make up most of it.
+class BlockGraph
+{
+public:
+	static constexpr uint32_t NoBlock = BlockIndex::NoBlock;
+
+	void Reset(uint32_t start, uint32_t end);
+	void Clear();
+	uint32_t Add(uint32_t start, uint32_t end, std::span<const uint32_t> dest_addresses);
+	void Link();
+	uint32_t Insert(uint32_t start, uint32_t end); // a linked block without edges
+	void Relink(uint32_t id, std::span<const uint32_t> dest_addresses);
+	uint32_t Split(uint32_t addr); // returns the id of the block starting at addr
+
+	Block& operator [] (uint32_t id);
+	const Block& operator [] (uint32_t id) const;
+	uint32_t Find(uint32_t addr) const; // NoBlock if no block contains addr
+	std::span<const uint32_t> Successors(uint32_t id) const;
+	std::span<const uint32_t> Predecessors(uint32_t id) const;
+	std::vector<uint32_t> ReversePostOrder() const; // from the blocks without predecessors first
+	std::vector<uint32_t> Closure(std::span<const uint32_t> ids, bool forward) const; // ids and every block they lead to, or that leads to them
+	size_t Size() const;
+private:
+	uint32_t Allocate(std::span<const uint32_t> ids);
+	uint32_t Reallocate(uint32_t first, uint32_t count, uint32_t id); // the list plus id, at the end
+	void Compact();
+
+	std::vector<Block> blocks;
+	std::vector<uint32_t> edges; // arena of edge lists
+	size_t unused{}; // arena entries no list uses any more
+	BlockIndex index;
+};
+
+#endif
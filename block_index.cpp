@@ -0,0 +1,88 @@
+#include "block_index.h"
+
+#include <algorithm>
+
+void BlockIndex::Reset(uint32_t start, uint32_t end)
+{
+    this->start = start;
+    this->end = end;
+    starts.clear();
+    ends.clear();
+    ids.clear();
+    pages.assign(((static_cast<size_t>(end - start) + (1 << PageShift) - 1) >> PageShift) + 1, 0);
+}
+
+void BlockIndex::Add(uint32_t block_start, uint32_t block_end, uint32_t id)
+{
+    // Pages ending before the new block are settled; the ones it reaches start at it or later
+    const size_t position = starts.size();
+    starts.push_back(block_start);
+    ends.push_back(block_end);
+    ids.push_back(id);
+    for (size_t page = std::min<size_t>((block_end - 1 - start) >> PageShift, pages.size() - 1) + 1; page < pages.size(); page++)
+        pages[page] = static_cast<uint32_t>(position + 1);
+}
+
+void BlockIndex::Insert(uint32_t block_start, uint32_t block_end, uint32_t id)
+{
+    const size_t position = std::ranges::upper_bound(starts, block_start) - starts.begin();
+    starts.insert(starts.begin() + position, block_start);
+    ends.insert(ends.begin() + position, block_end);
+    ids.insert(ids.begin() + position, id);
+
+    // Pages pointing before the new block still do. Of the others, the ones it reaches
+    // now start at it, and the rest moved up by one
+    const size_t first = std::ranges::lower_bound(pages, static_cast<uint32_t>(position)) - pages.begin();
+    for (size_t page = first; page < pages.size(); page++) {
+        const uint64_t page_start = start + (static_cast<uint64_t>(page) << PageShift);
+        pages[page] = page_start < block_end ? static_cast<uint32_t>(position) : pages[page] + 1;
+    }
+}
+
+void BlockIndex::Split(uint32_t addr, uint32_t id)
+{
+    const size_t position = Locate(addr);
+    if (position == starts.size() || starts[position] == addr)
+        return;
+
+    starts.insert(starts.begin() + position + 1, addr);
+    ends.insert(ends.begin() + position + 1, ends[position]);
+    ids.insert(ids.begin() + position + 1, id);
+    ends[position] = addr;
+
+    // Pages from the split on: the ones the old block no longer reaches start at the new one,
+    // and everything after it moved up by one
+    for (size_t page = (addr - start) >> PageShift; page < pages.size(); page++) {
+        const uint64_t page_start = start + (static_cast<uint64_t>(page) << PageShift);
+        if (pages[page] > position || (pages[page] == position && page_start >= addr))
+            pages[page]++;
+    }
+}
+
+size_t BlockIndex::Locate(uint32_t addr) const
+{
+    if (addr < start || addr >= end)
+        return starts.size();
+
+    // The block containing addr is between the first blocks reaching this page and the next
+    const size_t page = (addr - start) >> PageShift;
+    const auto first = starts.begin() + pages[page];
+    const auto last = starts.begin() + std::min<size_t>(pages[page + 1] + size_t{ 1 }, starts.size());
+    const auto it = std::upper_bound(first, last, addr);
+    if (it == first)
+        return starts.size();
+
+    const size_t position = it - starts.begin() - 1;
+    return addr < ends[position] ? position : starts.size();
+}
+
+uint32_t BlockIndex::Find(uint32_t addr) const
+{
+    const size_t position = Locate(addr);
+    return position == starts.size() ? NoBlock : ids[position];
+}
+
+size_t BlockIndex::Size() const
+{
+    return starts.size();
+}
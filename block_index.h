@@ -0,0 +1,38 @@
+#pragma once
+
+#ifndef BLOCK_INDEX_H
+#define BLOCK_INDEX_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Interval index over blocks that never overlap, kept sorted by start address.
+// Every 4 KB page of the code bounds points to the first block that can reach it,
+// so a lookup only binary searches the handful of blocks of one page.
+// Splitting a block updates the index in place instead of rebuilding it.
+class BlockIndex
+{
+public:
+	static constexpr uint32_t NoBlock = UINT32_MAX;
+
+	void Reset(uint32_t start, uint32_t end);
+	void Add(uint32_t start, uint32_t end, uint32_t id); // blocks must be added in address order
+	void Insert(uint32_t start, uint32_t end, uint32_t id); // anywhere between the existing blocks
+	void Split(uint32_t addr, uint32_t id); // the block containing addr now ends there; id covers the rest
+	uint32_t Find(uint32_t addr) const; // NoBlock if no block contains addr
+	size_t Size() const;
+private:
+	static constexpr uint32_t PageShift = 12;
+
+	size_t Locate(uint32_t addr) const; // position of the block containing addr, or starts.size()
+
+	std::vector<uint32_t> starts;
+	std::vector<uint32_t> ends; // exclusive
+	std::vector<uint32_t> ids;
+	std::vector<uint32_t> pages; // page of the code bounds -> first position whose block ends after its start
+	uint32_t start{};
+	uint32_t end{};
+};
+
+#endif
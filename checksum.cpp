@@ -0,0 +1,97 @@
+#include "checksum.h"
+
+#include <immintrin.h>
+#include <algorithm>
+
+#include "cpu.h"
+
+namespace
+{
+    // 32-bit lanes overflow after 65537 words each; flush them to 64 bits well before that
+    constexpr size_t FlushInterval = 0x8000;
+
+    uint64_t SumScalar(const uint8_t* data, size_t size)
+    {
+        uint64_t sum = 0;
+        for (size_t i = 0; i + 1 < size; i += 2)
+            sum += static_cast<uint32_t>(data[i]) | static_cast<uint32_t>(data[i + 1]) << 8;
+
+        // An odd trailing byte counts as a word with a zero high byte
+        if (size % 2)
+            sum += data[size - 1];
+        return sum;
+    }
+
+    uint64_t SumSSE2(const uint8_t* data, size_t size)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        uint64_t sum = 0;
+        size_t i = 0;
+
+        while (size - i >= 16) {
+            __m128i lanes = _mm_setzero_si128();
+            const size_t block_end = i + std::min((size - i) / 16, FlushInterval) * 16;
+            for (; i < block_end; i += 16) {
+                // Zero-extend the eight words to 32 bits and accumulate them
+                const __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                lanes = _mm_add_epi32(lanes, _mm_unpacklo_epi16(words, zero));
+                lanes = _mm_add_epi32(lanes, _mm_unpackhi_epi16(words, zero));
+            }
+
+            alignas(16) uint32_t partial[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(partial), lanes);
+            sum += static_cast<uint64_t>(partial[0]) + partial[1] + partial[2] + partial[3];
+        }
+
+        return sum + SumScalar(data + i, size - i);
+    }
+
+    uint64_t SumAVX2(const uint8_t* data, size_t size)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        uint64_t sum = 0;
+        size_t i = 0;
+
+        while (size - i >= 32) {
+            __m256i lanes = _mm256_setzero_si256();
+            const size_t block_end = i + std::min((size - i) / 32, FlushInterval) * 32;
+            for (; i < block_end; i += 32) {
+                // Zero-extend the sixteen words to 32 bits and accumulate them
+                const __m256i words = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                lanes = _mm256_add_epi32(lanes, _mm256_unpacklo_epi16(words, zero));
+                lanes = _mm256_add_epi32(lanes, _mm256_unpackhi_epi16(words, zero));
+            }
+
+            alignas(32) uint32_t partial[8];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(partial), lanes);
+            for (const uint32_t lane : partial)
+                sum += lane;
+        }
+
+        return sum + SumSSE2(data + i, size - i);
+    }
+
+    uint64_t SumWords(const uint8_t* data, size_t size)
+    {
+        return HasAVX2() ? SumAVX2(data, size) : SumSSE2(data, size);
+    }
+
+    uint32_t Fold(uint64_t sum)
+    {
+        // Add the carries back in until the sum fits in 16 bits
+        while (sum >> 16)
+            sum = (sum & 0xFFFF) + (sum >> 16);
+        return static_cast<uint32_t>(sum);
+    }
+}
+
+uint32_t ComputePEChecksum(const uint8_t* data, size_t size, size_t checksum_offset)
+{
+    uint64_t sum = SumWords(data, size);
+
+    // The checksum field is not part of the sum: take back what each of its bytes added
+    for (size_t i = checksum_offset; i < std::min(checksum_offset + sizeof(uint32_t), size); i++)
+        sum -= static_cast<uint64_t>(data[i]) << (i % 2 * 8);
+
+    return Fold(sum) + static_cast<uint32_t>(size);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstdint>
+#include <cstddef>
+
+// PE image checksum: one's-complement sum of the 16-bit words of the file,
+// with the checksum field itself read as zero, plus the length of the file.
+uint32_t ComputePEChecksum(const uint8_t* data, size_t size, size_t checksum_offset);
+
+#endif
@@ -0,0 +1,85 @@
+#include "classification.h"
+
+#include <algorithm>
+
+namespace
+{
+    // Stored so that zeroed memory is UNKNOWN and a stronger type is a larger value
+    constexpr uint64_t Encode(DETECTED_TYPE type)
+    {
+        constexpr uint64_t codes[] = { 3, 2, 1, 0 }; // CODE, DATA, POSSIBLE_DATA, UNKNOWN
+        return codes[type];
+    }
+
+    constexpr DETECTED_TYPE Decode(uint64_t code)
+    {
+        constexpr DETECTED_TYPE types[] = { UNKNOWN, POSSIBLE_DATA, DATA, CODE };
+        return types[code & 3];
+    }
+}
+
+ByteClassification::ByteClassification(uint32_t start, uint32_t end) :
+    words((static_cast<size_t>(end - start) + BytesPerWord - 1) / BytesPerWord), start(start), end(end)
+{
+}
+
+DETECTED_TYPE ByteClassification::Get(uint32_t rva) const
+{
+    if (rva < start || rva >= end)
+        return UNKNOWN;
+    const size_t offset = rva - start;
+    return Decode(words[offset / BytesPerWord].load(std::memory_order_relaxed) >> (offset % BytesPerWord * 2));
+}
+
+template <typename F>
+void ByteClassification::Update(uint32_t rva, size_t size, F&& update)
+{
+    // Clip to the bounds, then rewrite the bytes a word at a time
+    const size_t first = std::max(rva, start), last = std::min<size_t>(static_cast<size_t>(rva) + size, end);
+    if (first >= last)
+        return;
+    for (size_t offset = first - start; offset < last - start;) {
+        const size_t count = std::min(BytesPerWord - offset % BytesPerWord, last - start - offset);
+        const unsigned shift = static_cast<unsigned>(offset % BytesPerWord * 2);
+        const uint64_t mask = (count == BytesPerWord ? ~uint64_t{} : (uint64_t{ 1 } << count * 2) - 1) << shift;
+
+        std::atomic<uint64_t>& word = words[offset / BytesPerWord];
+        uint64_t expected = word.load(std::memory_order_relaxed);
+        while (!word.compare_exchange_weak(expected, update(expected, mask, shift, count), std::memory_order_relaxed))
+            ;
+        offset += count;
+    }
+}
+
+void ByteClassification::Raise(uint32_t rva, DETECTED_TYPE type, size_t size)
+{
+    // CODE is the strongest type, so raising to it is an OR
+    const uint64_t code = Encode(type);
+    if (type == CODE) {
+        Update(rva, size, [](uint64_t word, uint64_t mask, unsigned, size_t) { return word | mask; });
+        return;
+    }
+    Update(rva, size, [code](uint64_t word, uint64_t, unsigned shift, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            const unsigned bit = shift + static_cast<unsigned>(i * 2);
+            if ((word >> bit & 3) < code)
+                word = (word & ~(uint64_t{ 3 } << bit)) | code << bit;
+        }
+        return word;
+    });
+}
+
+void ByteClassification::Set(uint32_t rva, DETECTED_TYPE type, size_t size)
+{
+    // Repeat the two bits over the whole word, then keep the bytes being set
+    const uint64_t pattern = Encode(type) * 0x5555555555555555;
+    Update(rva, size, [pattern](uint64_t word, uint64_t mask, unsigned, size_t) {
+        return (word & ~mask) | (pattern & mask);
+    });
+}
+
+void ByteClassification::Clear()
+{
+    for (std::atomic<uint64_t>& word : words)
+        word.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#ifndef CLASSIFICATION_H
+#define CLASSIFICATION_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+enum DETECTED_TYPE
+{
+	CODE,
+	DATA,
+	POSSIBLE_DATA, // this could be data; shouldn't disassemble it
+	UNKNOWN
+};
+
+// What each byte of the code bounds was found to be, two bits per byte.
+// A byte only ever gets stronger (UNKNOWN < POSSIBLE_DATA < DATA < CODE) unless
+// Set says otherwise. Updates are lock-free, so the analysis threads classify
+// concurrently. Bytes outside the bounds read as UNKNOWN and ignore updates.
+class ByteClassification
+{
+public:
+	ByteClassification() = default;
+	ByteClassification(uint32_t start, uint32_t end);
+
+	DETECTED_TYPE Get(uint32_t rva) const;
+	void Raise(uint32_t rva, DETECTED_TYPE type, size_t size = 1);
+	void Set(uint32_t rva, DETECTED_TYPE type, size_t size = 1);
+	void Clear();
+private:
+	template <typename F>
+	void Update(uint32_t rva, size_t size, F&& update);
+
+	static constexpr size_t BytesPerWord = 32;
+
+	std::vector<std::atomic<uint64_t>> words;
+	uint32_t start{};
+	uint32_t end{};
+};
+
+#endif
@@ -0,0 +1,194 @@
+#include "code_scan.h"
+
+#include <immintrin.h>
+#include <algorithm>
+#include <bit>
+
+#include "cpu.h"
+#include "disassembler.h"
+
+namespace
+{
+    // One bit per byte of a 64-byte block for each class of byte
+    struct BlockMasks
+    {
+        uint64_t int3;
+        uint64_t nop;
+        uint64_t zero;
+    };
+
+    BlockMasks ClassifyScalar(const uint8_t* code, size_t size)
+    {
+        BlockMasks masks{};
+        for (size_t i = 0; i < size; i++) {
+            const uint64_t bit = uint64_t{ 1 } << i;
+            masks.int3 |= code[i] == 0xCC ? bit : 0;
+            masks.nop |= code[i] == 0x90 ? bit : 0;
+            masks.zero |= code[i] == 0x00 ? bit : 0;
+        }
+        return masks;
+    }
+
+    BlockMasks ClassifySSE2(const uint8_t* code)
+    {
+        BlockMasks masks{};
+        for (size_t i = 0; i < 64; i += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(code + i));
+            const auto mask = [&bytes](uint8_t value) {
+                return static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(value))))));
+            };
+            masks.int3 |= mask(0xCC) << i;
+            masks.nop |= mask(0x90) << i;
+            masks.zero |= mask(0x00) << i;
+        }
+        return masks;
+    }
+
+    BlockMasks ClassifyAVX2(const uint8_t* code)
+    {
+        BlockMasks masks{};
+        for (size_t i = 0; i < 64; i += 32) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(code + i));
+            const auto mask = [&bytes](uint8_t value) {
+                return static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(static_cast<char>(value))))));
+            };
+            masks.int3 |= mask(0xCC) << i;
+            masks.nop |= mask(0x90) << i;
+            masks.zero |= mask(0x00) << i;
+        }
+        return masks;
+    }
+
+    // Bits of mask that belong to a run of at least two set bits, given the bits just before and after the word
+    uint64_t Runs(uint64_t mask, uint64_t previous, uint64_t next)
+    {
+        const uint64_t before = mask << 1 | previous >> 63;
+        const uint64_t after = mask >> 1 | next << 63;
+        return mask & (before | after);
+    }
+}
+
+CodeScan::CodeScan(const uint8_t* image, uint32_t start, uint32_t end) :
+    start(start), end(end)
+{
+    const size_t words = (static_cast<size_t>(end - start) + 63) / 64;
+    padding.resize(words);
+    Classify(image + start);
+}
+
+void CodeScan::Classify(const uint8_t* code)
+{
+    const size_t size = end - start;
+    const size_t words = padding.size();
+    const bool avx2 = HasAVX2();
+
+    // Byte classes first, 64 bytes per word; the last partial block is done byte by byte
+    std::vector<uint64_t> int3(words), nop(words), zero(words);
+    for (size_t word = 0; word < words; word++) {
+        const size_t offset = word * 64;
+        const BlockMasks masks = size - offset < 64 ? ClassifyScalar(code + offset, size - offset)
+            : avx2 ? ClassifyAVX2(code + offset) : ClassifySSE2(code + offset);
+        int3[word] = masks.int3;
+        nop[word] = masks.nop;
+        zero[word] = masks.zero;
+    }
+
+    // Then keep the bytes that are part of a run, looking across word boundaries
+    for (size_t word = 0; word < words; word++) {
+        const auto runs = [&](const std::vector<uint64_t>& mask) {
+            return Runs(mask[word], word ? mask[word - 1] : 0, word + 1 < words ? mask[word + 1] : 0);
+        };
+        padding[word] = runs(int3) | runs(nop) | runs(zero);
+    }
+}
+
+void CodeScan::FindBoundaries(const uint8_t* image)
+{
+    // Decode linearly between the padding runs; after an undecodable byte, resynchronise on the next one
+    const uint8_t* code = image + start;
+    const size_t size = end - start;
+    boundaries.assign(padding.size(), 0);
+    size_t offset = 0;
+    while (offset < size) {
+        if (Test(padding, offset)) {
+            offset = SkipPadding(start + static_cast<uint32_t>(offset)) - start;
+            continue;
+        }
+
+        const uint8_t length = Disassembler::getInstructionLength(code + offset, size - offset);
+        if (!length) {
+            offset++;
+            continue;
+        }
+        boundaries[offset / 64] |= uint64_t{ 1 } << (offset % 64);
+        offset += length;
+    }
+}
+
+bool CodeScan::Test(const std::vector<uint64_t>& bitmap, size_t offset)
+{
+    return bitmap[offset / 64] >> (offset % 64) & 1;
+}
+
+uint32_t CodeScan::GetStart() const
+{
+    return start;
+}
+
+uint32_t CodeScan::GetEnd() const
+{
+    return end;
+}
+
+bool CodeScan::Contains(uint32_t rva) const
+{
+    return rva >= start && rva < end;
+}
+
+bool CodeScan::IsPadding(uint32_t rva) const
+{
+    return Contains(rva) && Test(padding, rva - start);
+}
+
+bool CodeScan::IsBoundary(uint32_t rva) const
+{
+    return Contains(rva) && !boundaries.empty() && Test(boundaries, rva - start);
+}
+
+uint32_t CodeScan::NextBoundary(uint32_t rva) const
+{
+    if (!Contains(rva) || boundaries.empty())
+        return rva;
+
+    // Look for the first set bit a word at a time
+    size_t offset = rva - start;
+    const size_t size = end - start;
+    while (offset < size) {
+        const uint64_t set = boundaries[offset / 64] >> (offset % 64);
+        if (set) {
+            offset += std::countr_zero(set);
+            break;
+        }
+        offset = (offset / 64 + 1) * 64;
+    }
+    return start + static_cast<uint32_t>(std::min(offset, size));
+}
+
+uint32_t CodeScan::SkipPadding(uint32_t rva) const
+{
+    if (!Contains(rva))
+        return rva;
+
+    // Look for the first clear bit a word at a time
+    size_t offset = rva - start;
+    const size_t size = end - start;
+    while (offset < size) {
+        const uint64_t clear = ~padding[offset / 64] >> (offset % 64);
+        if (clear) {
+            offset += std::countr_zero(clear);
+            break;
+        }
+        offset = (offset / 64 + 1) * 64;
+    }
+    return start + static_cast<uint32_t>(std::min(offset, size));
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#ifndef CODE_SCAN_H
+#define CODE_SCAN_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Bulk pre-pass over one code range, run before the disassembler follows any branch.
+// Padding (runs of two or more 0xCC, 0x90 or 0x00 bytes) is found 32 bytes at a time
+// with AVX2, or 16 with SSE2. On request, a linear decode of what lies between the
+// padding runs marks the candidate instruction boundaries the sweep starts from.
+class CodeScan
+{
+public:
+	CodeScan() = default;
+	CodeScan(const uint8_t* image, uint32_t start, uint32_t end);
+
+	void FindBoundaries(const uint8_t* image);
+
+	uint32_t GetStart() const;
+	uint32_t GetEnd() const;
+	bool Contains(uint32_t rva) const;
+	bool IsPadding(uint32_t rva) const;
+	bool IsBoundary(uint32_t rva) const; // false until FindBoundaries()
+	uint32_t SkipPadding(uint32_t rva) const; // first byte at or after rva that isn't padding
+	uint32_t NextBoundary(uint32_t rva) const; // first boundary at or after rva, or the end
+private:
+	void Classify(const uint8_t* code);
+	static bool Test(const std::vector<uint64_t>& bitmap, size_t offset);
+
+	uint32_t start{};
+	uint32_t end{};
+	std::vector<uint64_t> padding; // bit per byte of the range
+	std::vector<uint64_t> boundaries;
+};
+
+#endif
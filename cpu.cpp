@@ -0,0 +1,25 @@
+#include "cpu.h"
+
+#include <intrin.h>
+#include <immintrin.h>
+
+bool HasAVX2()
+{
+    // AVX2 needs both the CPU flag and the OS saving the YMM registers
+    static const bool avx2 = [] {
+        int info[4];
+        __cpuidex(info, 0, 0);
+        if (info[0] < 7)
+            return false;
+
+        __cpuidex(info, 1, 0);
+        const bool osxsave = info[2] & (1 << 27);
+        const bool avx = info[2] & (1 << 28);
+        if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+            return false;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }();
+    return avx2;
+}
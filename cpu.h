@@ -0,0 +1,9 @@
+#pragma once
+
+#ifndef CPU_H
+#define CPU_H
+
+// AVX2 is usable: the CPU supports it and the OS saves the YMM registers
+bool HasAVX2();
+
+#endif
@@ -0,0 +1,74 @@
+#pragma once
+
+#ifndef DECODED_INSTRUCTION_H
+#define DECODED_INSTRUCTION_H
+
+#include <cstdint>
+
+enum class INSTRUCTION_TYPE : uint8_t;
+enum class OP_TYPE : uint8_t;
+
+enum PREFIX : uint16_t
+{
+	PREFIX_LOCK = 1 << 0,
+	PREFIX_REPNE = 1 << 1,
+	PREFIX_REP = 1 << 2,
+	PREFIX_OPERAND_SIZE = 1 << 3,
+	PREFIX_ADDRESS_SIZE = 1 << 4,
+	PREFIX_ES = 1 << 5,
+	PREFIX_CS = 1 << 6,
+	PREFIX_SS = 1 << 7,
+	PREFIX_DS = 1 << 8,
+	PREFIX_FS = 1 << 9,
+	PREFIX_GS = 1 << 10,
+	PREFIX_VEX = 1 << 11 // VEX or EVEX encoded
+};
+
+// Arithmetic flags of EFLAGS
+enum FLAG : uint8_t
+{
+	FLAG_CF = 1 << 0,
+	FLAG_PF = 1 << 1,
+	FLAG_AF = 1 << 2,
+	FLAG_ZF = 1 << 3,
+	FLAG_SF = 1 << 4,
+	FLAG_OF = 1 << 5,
+	FLAGS_ALL = 0x3F
+};
+
+enum OPCODE_MAP : uint8_t
+{
+	MAP_ONE_BYTE,
+	MAP_0F,
+	MAP_0F38,
+	MAP_0F3A
+};
+
+// Everything derived from the bytes of an instruction, decoded once by
+// Disassembler::decodeInstruction and kept next to it in the InstructionStore.
+// Offsets are from the first byte of the instruction; a size of 0 means absent.
+struct DecodedInstruction
+{
+	uint16_t prefixes; // PREFIX mask
+	uint8_t length;
+	uint8_t opcodeOffset; // first opcode byte, after the prefixes
+	uint8_t opcode; // last opcode byte
+	OPCODE_MAP map;
+	uint8_t modrm;
+	uint8_t sib;
+	uint8_t hasModrm : 1;
+	uint8_t hasSib : 1;
+	uint8_t memoryOperand : 1; // ModRM (or moffs) addresses memory
+	uint8_t dispOffset;
+	uint8_t dispSize;
+	uint8_t immOffset;
+	uint8_t immSize;
+	uint8_t regsRead; // bit per REGISTER
+	uint8_t regsWritten;
+	uint8_t flagsRead; // FLAG mask
+	uint8_t flagsWritten; // including flags left undefined
+	INSTRUCTION_TYPE type;
+	OP_TYPE operands;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "dependency_graph.h"
+
+#include <bit>
+#include <stdexcept>
+
+#include "disassembler.h"
+
+namespace
+{
+    bool accessesMemory(const DecodedInstruction& decoded)
+    {
+        // LEA only computes the address; anything moving ESP goes through the stack
+        if (decoded.memoryOperand && !(decoded.map == MAP_ONE_BYTE && decoded.opcode == 0x8D))
+            return true;
+        return decoded.regsWritten & 1 << static_cast<int>(REGISTER::ESP);
+    }
+
+    // The memory operand is only read: loads, compares and sources of arithmetic into a register
+    bool isLoad(const DecodedInstruction& decoded)
+    {
+        const uint8_t op = decoded.opcode, reg = getReg(decoded.modrm);
+        if (decoded.regsWritten & 1 << static_cast<int>(REGISTER::ESP))
+            return false;
+        if (decoded.map == MAP_ONE_BYTE) {
+            if (op < 0x40 && ((op & 7) == 2 || (op & 7) == 3 || op == 0x38 || op == 0x39))
+                return true;
+            switch (op) {
+            case 0x69: case 0x6B: case 0x84: case 0x85: case 0x8A: case 0x8B: case 0xA0: case 0xA1:
+                return true;
+            case 0x80: case 0x81: case 0x82: case 0x83:
+                return reg == 7;
+            case 0xF6: case 0xF7:
+                return reg != 2 && reg != 3;
+            }
+            return false;
+        }
+        if (decoded.map == MAP_0F) {
+            if (op >= 0x40 && op <= 0x4F)
+                return true;
+            switch (op) {
+            case 0xA3: case 0xAF: case 0xB6: case 0xB7: case 0xB8: case 0xBC: case 0xBD: case 0xBE: case 0xBF:
+                return true;
+            case 0xBA:
+                return reg == 4;
+            }
+        }
+        return false;
+    }
+}
+
+uint32_t DependencyGraph::Reads(const DecodedInstruction& decoded)
+{
+    return getReadMask(decoded) | (accessesMemory(decoded) ? ResourceMemory : 0);
+}
+
+uint32_t DependencyGraph::Writes(const DecodedInstruction& decoded)
+{
+    return getWriteMask(decoded) | (accessesMemory(decoded) && !isLoad(decoded) ? ResourceMemory : 0);
+}
+
+bool DependencyGraph::IsModelled(const DecodedInstruction& decoded)
+{
+    // Segments, ports, the direction flag, x87 and vector state aren't in the masks
+    const uint8_t op = decoded.opcode;
+    if (decoded.prefixes & PREFIX_VEX)
+        return false;
+    if (decoded.map == MAP_ONE_BYTE) {
+        switch (op) {
+        case 0x06: case 0x07: case 0x0E: case 0x16: case 0x17: case 0x1E: case 0x1F: // segment registers
+        case 0x62: case 0x63: case 0x8C: case 0x8E: case 0x9A: case 0x9B: case 0x9D:
+        case 0xC4: case 0xC5: case 0xCC: case 0xCD: case 0xCE: case 0xCF: case 0xD7: case 0xF1: case 0xF4:
+        case 0xFA: case 0xFB: case 0xFC: case 0xFD:
+            return false;
+        }
+        return !(op >= 0x6C && op <= 0x6F) && !(op >= 0xA4 && op <= 0xAF) && !(op >= 0xD8 && op <= 0xDF)
+            && !(op >= 0xE4 && op <= 0xE7) && !(op >= 0xEC && op <= 0xEF);
+    }
+    if (decoded.map == MAP_0F) {
+        if ((op >= 0x40 && op <= 0x4F) || (op >= 0x80 && op <= 0x9F) || (op >= 0xC8 && op <= 0xCF))
+            return true;
+        switch (op) {
+        case 0x1F: case 0xA3: case 0xA4: case 0xA5: case 0xAB: case 0xAC: case 0xAD: case 0xAF:
+        case 0xB0: case 0xB1: case 0xB3: case 0xB6: case 0xB7: case 0xB8: case 0xBA: case 0xBB:
+        case 0xBC: case 0xBD: case 0xBE: case 0xBF: case 0xC0: case 0xC1:
+            return true;
+        }
+    }
+    return false;
+}
+
+void DependencyGraph::Build(const InstructionStore& code, size_t first, size_t count, uint32_t ignored)
+{
+    if (count > MaxSize)
+        throw std::invalid_argument("Too many instructions for a dependency graph.");
+    size = count;
+    successors.fill(0);
+
+    // For every resource, the last instruction writing it and the ones reading it since
+    std::array<uint64_t, 32> writer{}, readers{};
+    for (size_t j = 0; j < count; j++) {
+        const DecodedInstruction& decoded = code.getDecoded(first + j);
+        const uint32_t reads = Reads(decoded) & ~ignored, writes = Writes(decoded) & ~ignored;
+        uint64_t depends = 0;
+        for (uint32_t bits = reads; bits; bits &= bits - 1)
+            depends |= writer[std::countr_zero(bits)];
+        for (uint32_t bits = writes; bits; bits &= bits - 1)
+            depends |= writer[std::countr_zero(bits)] | readers[std::countr_zero(bits)];
+        predecessors[j] = depends;
+        for (uint64_t bits = depends; bits; bits &= bits - 1)
+            successors[std::countr_zero(bits)] |= uint64_t{ 1 } << j;
+
+        for (uint32_t bits = reads; bits; bits &= bits - 1)
+            readers[std::countr_zero(bits)] |= uint64_t{ 1 } << j;
+        for (uint32_t bits = writes; bits; bits &= bits - 1) {
+            writer[std::countr_zero(bits)] = uint64_t{ 1 } << j;
+            readers[std::countr_zero(bits)] = 0;
+        }
+    }
+}
+
+void DependencyGraph::Sample(std::mt19937& random, std::vector<uint32_t>& order) const
+{
+    // Place a random instruction among the ones whose predecessors are all placed, until none is left
+    order.clear();
+    std::array<uint8_t, MaxSize> waiting{};
+    uint64_t ready = 0;
+    for (size_t j = 0; j < size; j++) {
+        waiting[j] = static_cast<uint8_t>(std::popcount(predecessors[j]));
+        if (!waiting[j])
+            ready |= uint64_t{ 1 } << j;
+    }
+    while (ready) {
+        uint64_t bits = ready;
+        for (int pick = std::uniform_int_distribution<int>(0, std::popcount(ready) - 1)(random); pick; pick--)
+            bits &= bits - 1;
+        const uint32_t j = static_cast<uint32_t>(std::countr_zero(bits));
+        ready &= ~(uint64_t{ 1 } << j);
+        order.push_back(j);
+        for (uint64_t next = successors[j]; next; next &= next - 1) {
+            const int k = std::countr_zero(next);
+            if (!--waiting[k])
+                ready |= uint64_t{ 1 } << k;
+        }
+    }
+}
+
+size_t DependencyGraph::Size() const
+{
+    return size;
+}
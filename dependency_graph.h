@@ -0,0 +1,41 @@
+#pragma once
+
+#ifndef DEPENDENCY_GRAPH_H
+#define DEPENDENCY_GRAPH_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include "decoded_instruction.h"
+
+class InstructionStore;
+
+// What an instruction reads and writes: the RegisterMask bits, plus memory
+constexpr uint32_t ResourceMemory = 1 << 16;
+
+// Dependencies between a run of up to 64 consecutive instructions of a block,
+// from the registers, flags and memory each one reads and writes. Instruction j
+// depends on an earlier i if one writes what the other reads or writes; each
+// node keeps its predecessors and successors as bitmasks over the run.
+class DependencyGraph
+{
+public:
+	static constexpr size_t MaxSize = 64;
+
+	void Build(const InstructionStore& code, size_t first, size_t count, uint32_t ignored = 0);
+	void Sample(std::mt19937& random, std::vector<uint32_t>& order) const;
+	size_t Size() const;
+
+	static uint32_t Reads(const DecodedInstruction& decoded);
+	static uint32_t Writes(const DecodedInstruction& decoded);
+	static bool IsModelled(const DecodedInstruction& decoded); // the masks cover everything the instruction uses
+private:
+	std::array<uint64_t, MaxSize> predecessors{};
+	std::array<uint64_t, MaxSize> successors{};
+	size_t size{};
+};
+
+#endif
@@ -0,0 +1,33 @@
+#include "dirty_tracker.h"
+
+void DirtyTracker::Resize(size_t size)
+{
+    pages = (size + PageSize - 1) >> PageShift;
+    bitmap.resize((pages + 63) / 64);
+}
+
+void DirtyTracker::Mark(size_t offset, size_t size)
+{
+    if (!size)
+        return;
+
+    // Grow with the buffer instead of dropping writes past the end
+    const size_t last_page = (offset + size - 1) >> PageShift;
+    if (last_page >= pages)
+        Resize((last_page + 1) << PageShift);
+
+    for (size_t page = offset >> PageShift; page <= last_page; page++)
+        bitmap[page / 64] |= uint64_t{ 1 } << (page % 64);
+}
+
+void DirtyTracker::Clear()
+{
+    std::ranges::fill(bitmap, 0);
+}
+
+bool DirtyTracker::IsDirty(size_t offset, size_t size) const
+{
+    bool dirty = false;
+    ForEachExtent(offset, offset + size, [&dirty](size_t, size_t) { dirty = true; });
+    return dirty;
+}
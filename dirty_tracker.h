@@ -0,0 +1,56 @@
+#pragma once
+
+#ifndef DIRTY_TRACKER_H
+#define DIRTY_TRACKER_H
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Page-granular record of which parts of a buffer were written to.
+// Write-back walks the dirty extents instead of copying the whole buffer.
+class DirtyTracker
+{
+public:
+	static constexpr size_t PageShift = 12;
+	static constexpr size_t PageSize = size_t{ 1 } << PageShift;
+
+	void Resize(size_t size);
+	void Mark(size_t offset, size_t size);
+	void Clear();
+	bool IsDirty(size_t offset, size_t size) const;
+
+	// Call f(start, end) for each run of dirty pages, clipped to [begin, end)
+	template <typename F>
+	void ForEachExtent(size_t begin, size_t end, F&& f) const
+	{
+		size_t page = begin >> PageShift;
+		const size_t last_page = std::min((end + PageSize - 1) >> PageShift, pages);
+		while (page < last_page) {
+			// Skip clean pages a word at a time
+			const uint64_t word = bitmap[page / 64] >> (page % 64);
+			if (!word) {
+				page = (page / 64 + 1) * 64;
+				continue;
+			}
+			page += std::countr_zero(word);
+			if (page >= last_page)
+				break;
+
+			// Extend the run over the following dirty pages
+			size_t run_end = page + 1;
+			while (run_end < last_page && bitmap[run_end / 64] >> (run_end % 64) & 1)
+				run_end++;
+
+			f(std::max(page << PageShift, begin), std::min(run_end << PageShift, end));
+			page = run_end;
+		}
+	}
+private:
+	std::vector<uint64_t> bitmap;
+	size_t pages{};
+};
+
+#endif
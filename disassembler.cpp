@@ -0,0 +1,1574 @@
+#include "disassembler.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+
+#include "opcodes.h"
+
+namespace
+{
+    // Bytes of unreached code given to one linear sweep task
+    constexpr uint32_t SweepChunkSize = 0x4000;
+
+    unsigned getThreadCount(unsigned threads)
+    {
+        return threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+uint8_t getMod(uint8_t modrm)
+{
+    return modrm >> 6;
+}
+
+uint8_t getReg(uint8_t modrm)
+{
+    return (modrm >> 3) & 7;
+}
+
+uint8_t getRM(uint8_t modrm)
+{
+    return modrm & 7;
+}
+
+Disassembler::Disassembler(PEParser& parser) :
+    parser(parser), VirtualImage(parser.GetVirtualImage()), patches(VirtualImage),
+    code_bounds(parser.GetCodeSectionsVirtualBounds()),
+    imageBase(parser.GetImageBase()), entryPoint(parser.GetEntryPoint()),
+    startOfEntrySection(parser.GetEntryPoint() - parser.GetRelativeEntryPoint())
+{
+    code.attach(patches);
+}
+
+const InstructionStore& Disassembler::getCode() const
+{
+    return code;
+}
+
+const BlockGraph& Disassembler::getBlocks() const
+{
+    return blocks;
+}
+
+void Disassembler::editInstruction(uint32_t addr, std::span<const uint8_t> instruction)
+{
+    DecodedInstruction decoded;
+    if (!decodeInstruction(instruction.data(), instruction.size(), decoded) || decoded.length != instruction.size())
+        throw std::invalid_argument(generateOpCodeErrorInfo("Edit isn't a single valid instruction", addr));
+
+    // Boundaries never move: a replacement fits in what the instruction it replaces took up,
+    // NOPs from an earlier edit included, and is padded with NOPs up to there again; a new
+    // instruction (e.g. in an added section) only goes where there is none
+    const auto found = code.find(addr);
+    uint32_t end = addr + decoded.length;
+    if (found != code.end()) {
+        end = code.getEnd(found.getIndex());
+        if (addr + decoded.length > end)
+            throw std::invalid_argument(generateOpCodeErrorInfo("Edit is longer than the instruction it replaces", addr));
+    }
+    else {
+        const auto next = code.lowerBound(addr);
+        if ((next != code.end() && code.getAddress(next.getIndex()) < end)
+            || (next != code.begin() && code.getEnd(next.getIndex() - 1) > addr))
+            throw std::invalid_argument(generateOpCodeErrorInfo("Edit overlaps another instruction", addr));
+    }
+
+    // The loader would write over the new bytes
+    if (parser.IsRelocated(addr, end - addr))
+        throw std::invalid_argument(generateOpCodeErrorInfo("Edit covers a relocated address", addr));
+
+    std::vector<uint8_t> bytes(end - addr, 0x90);
+    std::ranges::copy(instruction, bytes.begin());
+    patches.Write(addr, bytes);
+    if (found != code.end())
+        code.replace(found.getIndex(), decoded, static_cast<uint8_t>(end - addr - decoded.length));
+    else {
+        code.add(addr, decoded, INSTRUCTION_EDITED | INSTRUCTION_ADDED);
+        code.seal();
+    }
+    edits.push_back(addr);
+}
+
+void Disassembler::discardEdits()
+{
+    // The image still has the original bytes under every patch
+    patches.Seal();
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    patches.ForEach([&ranges](uint32_t addr, std::span<const uint8_t> bytes) {
+        ranges.emplace_back(addr, addr + static_cast<uint32_t>(bytes.size()));
+    });
+    patches.Clear();
+
+    // Edited instructions are decoded again from the image in place, keeping what they took up
+    // (NOPs committed with an earlier edit included); moved ones only have the original
+    // boundaries as a whole, so each of their runs is read from its start
+    std::vector<size_t> dropped;
+    std::vector<std::tuple<uint32_t, uint32_t, uint8_t>> stretches;
+    for (const auto& [start, end] : ranges) {
+        for (auto it = code.lowerBound(start); it != code.end() && code.getAddress(it.getIndex()) < end; ++it) {
+            const size_t index = it.getIndex();
+            const uint32_t addr = code.getAddress(index);
+            const uint8_t flags = code.getFlags(index);
+            if (!(flags & (INSTRUCTION_EDITED | INSTRUCTION_ADDED)))
+                continue;
+            edits.push_back(addr);
+            const uint32_t next = code.getEnd(index);
+            if (!(flags & (INSTRUCTION_ADDED | INSTRUCTION_MOVED))) {
+                const DecodedInstruction decoded = readInstruction(addr);
+                code.replace(index, decoded, static_cast<uint8_t>(next - addr - decoded.length));
+                code.setFlags(index, flags & ~INSTRUCTION_EDITED);
+                continue;
+            }
+            dropped.push_back(index);
+            if (flags & INSTRUCTION_ADDED)
+                continue;
+            if (!stretches.empty() && std::get<1>(stretches.back()) == addr)
+                std::get<1>(stretches.back()) = next;
+            else
+                stretches.emplace_back(addr, next, flags & ~INSTRUCTION_EDITED);
+        }
+    }
+    code.erase(dropped);
+    for (const auto& [start, end, flags] : stretches) {
+        for (uint32_t addr = start; addr < end;) {
+            const DecodedInstruction decoded = readInstruction(addr);
+            code.add(addr, decoded, flags & ~INSTRUCTION_MOVED);
+            edits.push_back(addr);
+            addr += decoded.length;
+        }
+    }
+    code.seal();
+}
+
+void Disassembler::reorderInstructions(uint32_t addr, std::span<const uint32_t> order)
+{
+    // The run keeps its place and size, so nothing outside it moves
+    const auto it = code.find(addr);
+    if (it == code.end() || it.getIndex() + order.size() > code.size())
+        throw std::invalid_argument(generateOpCodeErrorInfo("No run of instructions to reorder", addr));
+    const size_t first = it.getIndex();
+    uint32_t size = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+        if (code.getAddress(first + i) != addr + size)
+            throw std::invalid_argument(generateOpCodeErrorInfo("Instructions to reorder aren't contiguous", addr));
+        size += code.getEnd(first + i) - code.getAddress(first + i);
+    }
+
+    std::vector<bool> placed(order.size());
+    for (const uint32_t i : order) {
+        if (i >= order.size() || placed[i])
+            throw std::invalid_argument(generateOpCodeErrorInfo("Order isn't a permutation of the run", addr));
+        placed[i] = true;
+    }
+
+    std::vector<uint8_t> reordered;
+    reordered.reserve(size);
+    for (const uint32_t i : order) {
+        const auto instruction = code.getBytes(first + i);
+        reordered.insert(reordered.end(), instruction.begin(), instruction.end());
+        reordered.resize(reordered.size() + (code.getEnd(first + i) - code.getAddress(first + i) - instruction.size()), 0x90);
+        edits.push_back(code.getAddress(first + i));
+    }
+    patches.Write(addr, reordered);
+    code.reorder(first, order);
+    for (size_t i = 0; i < order.size(); i++)
+        edits.push_back(code.getAddress(first + i));
+}
+
+void Disassembler::reanalyze()
+{
+    // Only the blocks around the edits are revisited; everything else keeps its analysis.
+    // The patches of the whole round are sorted and merged once, before anything is decoded
+    patches.Seal();
+    std::ranges::sort(edits);
+    edits.erase(std::unique(edits.begin(), edits.end()), edits.end());
+    std::vector<uint32_t> dirty; // addresses in blocks whose successors may have changed
+    std::vector<uint32_t> targets; // new branch destinations
+    std::vector<uint32_t> unreferenced; // what the old bytes referred to, which may no longer be entered from outside
+    AnalysisResult result;
+    result.code.attach(patches);
+    WorkQueue queue(1);
+    const size_t known = blocks.Size();
+    bool rebuild = false; // a block starts where an instruction is gone
+    for (const uint32_t addr : edits) {
+        if (addr < codeStart || addr >= codeEnd)
+            continue;
+
+        // The branch and references of the old bytes give way to those of the new bytes, if the instruction is still there
+        const auto [first, last] = std::ranges::equal_range(branches, addr, {}, &Branch::source);
+        branches.erase(first, last);
+        xrefs.RemoveBranchesFrom(addr);
+        const auto [first_reference, last_reference] = std::ranges::equal_range(references, addr, {}, &std::pair<uint32_t, uint32_t>::second);
+        for (auto reference = first_reference; reference != last_reference; ++reference)
+            unreferenced.push_back(reference->first);
+        references.erase(first_reference, last_reference);
+        xrefs.RemoveReferencesFrom(addr);
+        const auto it = code.find(addr);
+        if (it == code.end()) {
+            const uint32_t id = blocks.Find(addr);
+            rebuild |= id != BlockGraph::NoBlock && blocks[id].start_address == addr;
+            continue;
+        }
+        const InstructionStore::Instruction instruction = *it;
+        findReferences(addr, instruction.bytes, instruction.decoded, result);
+        Branch branch;
+        if (getBranch(addr, instruction.bytes, instruction.decoded, branch)) {
+            branches.insert(std::ranges::upper_bound(branches, addr, {}, &Branch::source), branch);
+            xrefs.AddBranch(branch);
+            if (isCodeBranch(branch)) {
+                targets.push_back(branch.dest);
+                if (!code.contains(branch.dest))
+                    queue.Push(0, branch.dest);
+            }
+        }
+
+        // An instruction that now ends its block splits it at the next instruction it doesn't overlap
+        const uint32_t id = blocks.Find(addr);
+        if (id == BlockGraph::NoBlock)
+            continue;
+        const auto next = code.lowerBound(instruction.end);
+        if (endsBlock(instruction.decoded) && next != code.end() && code.getAddress(next.getIndex()) < blocks[id].end_address)
+            blocks.Split(code.getAddress(next.getIndex()));
+        dirty.push_back(addr);
+    }
+    edits.clear();
+
+    // Code only the new destinations reach is decoded here, on this thread
+    uint32_t addr;
+    while (queue.Pop(0, addr)) {
+        readCode(addr, queue, 0, result);
+        queue.Done();
+    }
+    if (!result.code.empty()) {
+        result.code.seal();
+        code.append(result.code);
+        code.seal();
+    }
+    std::ranges::sort(result.branches, {}, &Branch::source);
+    const size_t merged = branches.size();
+    branches.insert(branches.end(), result.branches.begin(), result.branches.end());
+    std::inplace_merge(branches.begin(), branches.begin() + merged, branches.end(),
+        [](const Branch& a, const Branch& b) { return a.source < b.source; });
+    std::ranges::sort(result.references, {}, &std::pair<uint32_t, uint32_t>::second);
+    const size_t merged_references = references.size();
+    references.insert(references.end(), result.references.begin(), result.references.end());
+    std::inplace_merge(references.begin(), references.begin() + merged_references, references.end(),
+        [](const auto& a, const auto& b) { return a.second < b.second; });
+    for (const Branch& branch : result.branches) {
+        xrefs.AddBranch(branch);
+        if (isCodeBranch(branch))
+            targets.push_back(branch.dest);
+    }
+    for (const auto& [dest, source] : result.references)
+        xrefs.AddReference(dest, source);
+
+    // Discarding an added instruction can leave a block starting where there is no instruction
+    // any more; there is no merging blocks back, so they are read again
+    if (rebuild) {
+        buildBlocks();
+        registerValues.Build(blocks, code, getEntryBlocks());
+        liveness.Build(blocks, code, getExitBlocks());
+        return;
+    }
+
+    // Destinations in the middle of a block start a block of their own
+    for (const uint32_t dest : targets)
+        if (code.contains(dest))
+            blocks.Split(dest);
+
+    // New code gets its own blocks, and whatever fell off the decoded code into them is linked too
+    std::vector<uint32_t> dest_addresses;
+    for (const InstructionStore::Instruction instruction : result.code) {
+        if (isAddrInBlock(instruction.address))
+            continue;
+        dest_addresses.clear();
+        const Block block = readBlocks(instruction.address, dest_addresses);
+        blocks.Insert(block.start_address, block.end_address);
+        dirty.push_back(block.start_address);
+        dirty.push_back(block.start_address - 1);
+    }
+
+    // Splits moved some of the edited instructions to other blocks, so they are only found now
+    std::vector<uint32_t> ids;
+    for (const uint32_t dirty_addr : dirty)
+        if (const uint32_t id = blocks.Find(dirty_addr); id != BlockGraph::NoBlock)
+            ids.push_back(id);
+    std::ranges::sort(ids);
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    std::vector<uint32_t> changed = ids;
+    for (const uint32_t id : ids) {
+        // Where the block went before may have lost its last predecessor
+        changed.insert(changed.end(), blocks.Successors(id).begin(), blocks.Successors(id).end());
+        linkBlock(id);
+    }
+
+    // Values and liveness are propagated again from what the edits changed: the relinked blocks and
+    // where they went and go now, the blocks references went to and new branches and references go to, and both halves of every split
+    for (const uint32_t id : ids)
+        changed.insert(changed.end(), blocks.Successors(id).begin(), blocks.Successors(id).end());
+    for (const uint32_t dest : targets)
+        changed.push_back(blocks.Find(dest));
+    for (const auto& [dest, source] : result.references)
+        changed.push_back(blocks.Find(dest));
+    for (const uint32_t dest : unreferenced)
+        changed.push_back(blocks.Find(dest));
+    for (uint32_t id = static_cast<uint32_t>(known); id < blocks.Size(); id++) {
+        changed.push_back(id);
+        changed.push_back(blocks.Find(blocks[id].start_address - 1));
+    }
+    std::erase(changed, BlockGraph::NoBlock);
+    std::ranges::sort(changed);
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    std::vector<uint32_t> entries;
+    std::ranges::copy_if(changed, std::back_inserter(entries), [this](uint32_t id) { return isEntryBlock(id); });
+    std::vector<uint32_t> exits;
+    std::ranges::copy_if(changed, std::back_inserter(exits), [this](uint32_t id) { return isExitBlock(id); });
+    registerValues.Update(blocks, code, changed, entries);
+    liveness.Update(blocks, code, changed, exits);
+}
+
+void Disassembler::UpdateVirtualImageFromInstructions()
+{
+    // Only the patched bytes differ from the virtual image
+    patches.ForEach([this](uint32_t addr, std::span<const uint8_t> bytes) {
+        std::ranges::copy(bytes, VirtualImage + addr);
+        parser.MarkDirty(addr, bytes.size());
+        for (auto it = code.lowerBound(addr); it != code.end() && code.getAddress(it.getIndex()) < addr + bytes.size(); ++it)
+            code.setFlags(it.getIndex(), code.getFlags(it.getIndex()) & ~(INSTRUCTION_EDITED | INSTRUCTION_ADDED | INSTRUCTION_MOVED));
+    });
+    patches.Clear();
+}
+
+void Disassembler::addOpCodes(std::vector<uint8_t>& instruction, uint32_t addr, unsigned count)
+{
+    // Append count bytes of the image starting at addr, as edited
+    instruction.resize(instruction.size() + count);
+    patches.Read(addr, std::span(instruction).last(count));
+}
+
+uint32_t Disassembler::getBranchDestination(uint32_t addr) const
+{
+    const auto it = code.find(addr);
+    if (it == code.end())
+        return 0;
+    const InstructionStore::Instruction instruction = *it;
+    if (const uint32_t dest = getBranchDestination(addr, instruction.bytes, instruction.decoded))
+        return dest;
+
+    // JMP reg ends its block, so the register holds its value at the end of the block
+    const DecodedInstruction& decoded = instruction.decoded;
+    if (decoded.map != MAP_ONE_BYTE || decoded.opcode != 0xFF || (decoded.prefixes & PREFIX_OPERAND_SIZE)
+        || getReg(decoded.modrm) != 4 || getMod(decoded.modrm) != 3)
+        return 0;
+    const uint32_t id = blocks.Find(addr);
+    if (id == BlockGraph::NoBlock)
+        return 0;
+    const BlockRegister& target = registerValues.AtExit(id)[getRM(decoded.modrm)];
+    if (!target.is_value_known)
+        return 0;
+    const uint32_t dest = static_cast<uint32_t>(target.value) - imageBase;
+    return isAddressInternal(dest) ? dest : 0;
+}
+
+uint32_t Disassembler::getBranchDestination(uint32_t addr, std::span<const uint8_t> instruction, const DecodedInstruction& decoded)
+{
+    // Only relative branches have a destination known from their bytes; 0 for the others
+    const uint8_t op = decoded.opcode;
+    const bool relative = decoded.prefixes & PREFIX_VEX ? false
+        : decoded.map == MAP_ONE_BYTE ? (op >= 0x70 && op <= 0x7F) || (op >= 0xE0 && op <= 0xE3) || op == 0xE8 || op == 0xE9 || op == 0xEB
+        : decoded.map == MAP_0F && op >= 0x80 && op <= 0x8F;
+    if (!relative)
+        return 0;
+
+    const uint8_t* imm = instruction.data() + decoded.immOffset;
+    int32_t displacement;
+    switch (decoded.immSize) {
+    case 1:
+        displacement = static_cast<int8_t>(imm[0]);
+        break;
+    case 2:
+        displacement = static_cast<int16_t>(imm[0] | imm[1] << 8);
+        break;
+    default:
+        displacement = static_cast<int32_t>(imm[0] | imm[1] << 8 | imm[2] << 16 | static_cast<uint32_t>(imm[3]) << 24);
+        break;
+    }
+    return addr + decoded.length + displacement;
+}
+
+RegisterMask Disassembler::getLiveAfter(uint32_t addr) const
+{
+    const uint32_t id = blocks.Find(addr);
+    return id == BlockGraph::NoBlock ? MaskAll : liveness.LiveAfter(id, addr);
+}
+
+bool Disassembler::getBranch(uint32_t addr, std::span<const uint8_t> instruction, const DecodedInstruction& decoded, Branch& branch) const
+{
+    const INSTRUCTION_TYPE type = decoded.type;
+    if (type != INSTRUCTION_TYPE::C_JMP && type != INSTRUCTION_TYPE::UNC_JMP && type != INSTRUCTION_TYPE::CALL)
+        return false;
+    if (const uint32_t slot = getImportSlot(instruction, decoded)) {
+        branch = { type == INSTRUCTION_TYPE::CALL ? BRANCH_TYPE::IMPORT_CALL : BRANCH_TYPE::IMPORT_JMP, addr, slot };
+        return true;
+    }
+    const uint32_t dest = getBranchDestination(addr, instruction, decoded);
+    const bool known = dest != 0;
+    const BRANCH_TYPE branch_type = type == INSTRUCTION_TYPE::C_JMP ? (known ? BRANCH_TYPE::COND_JMP : BRANCH_TYPE::REGULAR_COND_JMP)
+        : type == INSTRUCTION_TYPE::UNC_JMP ? (known ? BRANCH_TYPE::JMP : BRANCH_TYPE::REGULAR_JMP)
+        : known ? BRANCH_TYPE::CALL : BRANCH_TYPE::REGULAR_CALL;
+    // readCode starts past a NOP run, so the edges and xrefs go to where the code is
+    branch = { branch_type, addr, known ? skipNops(dest) : 0 };
+    return true;
+}
+
+uint32_t Disassembler::getImportSlot(std::span<const uint8_t> instruction, const DecodedInstruction& decoded) const
+{
+    // FF /2 or FF /4 with an absolute disp32 operand, pointing at a slot the loader fills
+    if (decoded.map != MAP_ONE_BYTE || decoded.opcode != 0xFF || (decoded.prefixes & PREFIX_ADDRESS_SIZE)
+        || (getReg(decoded.modrm) != 2 && getReg(decoded.modrm) != 4) || getMod(decoded.modrm) != 0 || getRM(decoded.modrm) != 5)
+        return 0;
+    uint32_t value;
+    std::memcpy(&value, instruction.data() + decoded.dispOffset, sizeof(value));
+    return value >= imageBase && parser.GetImports().IsSlot(value - imageBase) ? value - imageBase : 0;
+}
+
+const ImportedFunction* Disassembler::getImport(uint32_t addr) const
+{
+    for (const Branch& branch : xrefs.BranchesFrom(addr))
+        if (branch.type == BRANCH_TYPE::IMPORT_CALL || branch.type == BRANCH_TYPE::IMPORT_JMP)
+            return parser.GetImports().FindBySlot(branch.dest);
+    return nullptr;
+}
+
+bool Disassembler::isAddressInternal(uint32_t address) const
+{
+    return parser.IsExecutable(address);
+}
+
+DecodedInstruction Disassembler::readInstruction(uint32_t addr) const
+{
+    // The instruction can't run past the end of its section
+    const SectionHeader* section = parser.SectionOf(addr);
+    if (!section || !(section->characteristics & IMAGE_SCN_MEM_EXECUTE))
+        throw std::runtime_error(generateOpCodeErrorInfo("Address outside of code", addr));
+
+    // Edited bytes are only copied out when the instruction could reach them
+    size_t size = section->virtualAddress + section->virtualSize - addr;
+    const uint8_t* bytes = VirtualImage + addr;
+    uint8_t patched[15];
+    if (patches.Overlaps(addr, std::min(size, sizeof(patched)))) {
+        size = std::min(size, sizeof(patched));
+        patches.Read(addr, { patched, size });
+        bytes = patched;
+    }
+
+    DecodedInstruction decoded;
+    if (!decodeInstruction(bytes, size, decoded))
+        throw std::runtime_error(generateOpCodeErrorInfo("Invalid or truncated instruction", addr));
+    return decoded;
+}
+
+void Disassembler::analyze(unsigned threads)
+{
+    patches.Seal();
+    code.clear();
+    branches.clear();
+    references.clear();
+    edits.clear();
+
+    // Classify the code ranges in bulk before following anything
+    scans.clear();
+    codeStart = UINT32_MAX;
+    codeEnd = 0;
+    for (const auto& [start, end] : code_bounds) {
+        scans.emplace_back(VirtualImage, start, end);
+        codeStart = std::min(codeStart, start);
+        codeEnd = std::max(codeEnd, end);
+    }
+    visited = std::vector<std::atomic<uint64_t>>((codeEnd - codeStart + 63) / 64);
+    referencedAddresses = ByteClassification(codeStart, codeEnd);
+
+    // Recursive descent on every thread, each one collecting its own results
+    threads = getThreadCount(threads);
+    WorkQueue queue(threads);
+    std::vector<AnalysisResult> results(threads);
+    std::vector<std::exception_ptr> errors(threads);
+    queue.Push(0, entryPoint);
+
+    const auto worker = [&](size_t index) {
+        bool following = false;
+        try {
+            uint32_t addr;
+            while (queue.Pop(index, addr)) {
+                following = true;
+                readCode(addr, queue, index, results[index]);
+                following = false;
+                queue.Done();
+            }
+        }
+        catch (...) {
+            errors[index] = std::current_exception();
+            // The target that threw is over too; keep draining so the other threads can finish
+            if (following)
+                queue.Done();
+            uint32_t addr;
+            while (queue.Pop(index, addr))
+                queue.Done();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; i++)
+        pool.emplace_back(worker, i);
+    worker(0);
+    for (std::thread& thread : pool)
+        thread.join();
+    for (const std::exception_ptr& error : errors)
+        if (error)
+            std::rethrow_exception(error);
+
+    // Merge the instructions and branches of every thread
+    size_t count = 0;
+    for (const AnalysisResult& result : results)
+        count += result.code.size();
+    code.reserve(count);
+    for (AnalysisResult& result : results) {
+        code.append(result.code);
+        branches.insert(branches.end(), result.branches.begin(), result.branches.end());
+        references.insert(references.end(), result.references.begin(), result.references.end());
+    }
+    code.seal();
+    std::ranges::sort(branches, {}, &Branch::source);
+    findDataReferences();
+    std::ranges::sort(references, {}, &std::pair<uint32_t, uint32_t>::second);
+    xrefs.Build(branches, references, codeStart, codeEnd);
+    buildBlocks();
+    registerValues.Build(blocks, code, getEntryBlocks());
+    liveness.Build(blocks, code, getExitBlocks());
+}
+
+void Disassembler::sweep(unsigned threads)
+{
+    // A chunk of an unreached stretch of code, decoded from a guessed boundary.
+    // Decoding only depends on the position, so two decodes that reach the same
+    // position agree from there on.
+    struct Chunk
+    {
+        const CodeScan* scan;
+        uint32_t start;
+        uint32_t end;
+        uint32_t limit; // end of the stretch: instructions can run past the chunk, not past this
+        std::vector<uint32_t> positions{}; // every position decoded from, in order
+        std::vector<DecodedInstruction> decoded{}; // length 0 where decoding failed
+        uint32_t exit{}; // position following the last one
+    };
+
+    // Decode at a position, then move past the instruction (or a byte that isn't one) and any padding
+    patches.Seal();
+    const auto step = [this](const Chunk& chunk, uint32_t pos, DecodedInstruction& decoded) {
+        // Edits that aren't committed yet are read through the overlay, as readInstruction does
+        size_t size = chunk.limit - pos;
+        const uint8_t* bytes = VirtualImage + pos;
+        uint8_t patched[15];
+        if (patches.Overlaps(pos, std::min(size, sizeof(patched)))) {
+            size = std::min(size, sizeof(patched));
+            patches.Read(pos, { patched, size });
+            bytes = patched;
+        }
+        decodeInstruction(bytes, size, decoded);
+        pos += decoded.length ? decoded.length : 1;
+        return pos < chunk.limit && chunk.scan->IsPadding(pos) ? std::min(chunk.scan->SkipPadding(pos), chunk.limit) : pos;
+    };
+
+    // Split the unreached stretches of every code range into chunks, cut where the linear
+    // pre-decode found an instruction so that most chunks start in step with their predecessor
+    std::vector<Chunk> chunks;
+    for (CodeScan& scan : scans) {
+        scan.FindBoundaries(VirtualImage);
+        uint32_t addr = scan.GetStart();
+        while ((addr = findVisited(addr, scan.GetEnd(), false)) < scan.GetEnd()) {
+            if (scan.IsPadding(addr)) {
+                addr = scan.SkipPadding(addr);
+                continue;
+            }
+            const uint32_t end = findVisited(addr, scan.GetEnd(), true);
+            for (uint32_t start = addr; start < end;) {
+                const uint32_t cut = end - start > SweepChunkSize ? std::min(scan.NextBoundary(start + SweepChunkSize), end) : end;
+                chunks.push_back({ &scan, start, cut, end });
+                start = cut;
+            }
+            addr = end;
+        }
+    }
+
+    // Decode every chunk on its own, from its first byte
+    std::atomic<size_t> next{};
+    const auto worker = [&]() {
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < chunks.size();) {
+            Chunk& chunk = chunks[i];
+            uint32_t pos = chunk.start;
+            while (pos < chunk.end) {
+                DecodedInstruction decoded;
+                const uint32_t following = step(chunk, pos, decoded);
+                chunk.positions.push_back(pos);
+                chunk.decoded.push_back(decoded);
+                pos = following;
+            }
+            chunk.exit = pos;
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < getThreadCount(threads); i++)
+        pool.emplace_back(worker);
+    worker();
+    for (std::thread& thread : pool)
+        thread.join();
+
+    // Stitch the chunks in order. The first chunk of a stretch starts on a real boundary,
+    // the others where their predecessor really ended: if the guess missed that position,
+    // decode from it until it meets the chunk's own decode, usually within a few instructions.
+    // Swept instructions stay UNKNOWN: nothing proves they are ever executed
+    const auto record = [&](uint32_t pos, const DecodedInstruction& decoded) {
+        if (decoded.length) {
+            code.add(pos, decoded, INSTRUCTION_SWEPT);
+            markVisited(pos, decoded.length);
+        }
+        else
+            referencedAddresses.Raise(pos, POSSIBLE_DATA);
+    };
+
+    uint32_t entry = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        const Chunk& chunk = chunks[i];
+        const bool continued = i && chunks[i - 1].limit == chunk.limit;
+        uint32_t pos = continued ? entry : chunk.start;
+
+        auto it = std::ranges::lower_bound(chunk.positions, pos);
+        while (pos < chunk.end && (it == chunk.positions.end() || *it != pos)) {
+            DecodedInstruction decoded;
+            const uint32_t following = step(chunk, pos, decoded);
+            record(pos, decoded);
+            pos = following;
+            it = std::lower_bound(it, chunk.positions.end(), pos);
+        }
+        if (pos >= chunk.end) {
+            entry = pos;
+            continue;
+        }
+
+        for (; it != chunk.positions.end(); ++it)
+            record(*it, chunk.decoded[it - chunk.positions.begin()]);
+        entry = chunk.exit;
+    }
+    code.seal();
+}
+
+void Disassembler::readCode(uint32_t addr, WorkQueue& queue, size_t worker, AnalysisResult& result)
+{
+    // Follow one path until it leaves the code, meets decoded bytes or stops; targets go to the queue
+    uint32_t current = addr;
+    for (;;) {
+        const CodeScan* scan = getScan(current);
+        if (!scan)
+            break;
+
+        // Filler between functions is never reached; NOP runs are, and are skipped in one step
+        if (scan->IsPadding(current)) {
+            if (VirtualImage[current] != 0x90)
+                break;
+            current = skipNops(current);
+            continue;
+        }
+
+        // Whichever thread sets the bit first decodes the instruction
+        if (!claim(current))
+            break;
+
+        DecodedInstruction decoded;
+        try {
+            decoded = readInstruction(current);
+        }
+        catch (const std::runtime_error&) {
+            // The path ran into bytes that aren't code
+            referencedAddresses.Raise(current, POSSIBLE_DATA);
+            break;
+        }
+        markVisited(current + 1, decoded.length - 1);
+        referencedAddresses.Raise(current, CODE, decoded.length);
+        result.code.add(current, decoded);
+        uint8_t bytes[15];
+        patches.Read(current, { bytes, decoded.length });
+        findReferences(current, { bytes, decoded.length }, decoded, result);
+
+        Branch branch;
+        if (getBranch(current, { bytes, decoded.length }, decoded, branch)) {
+            result.branches.push_back(branch);
+            if (isCodeBranch(branch))
+                queue.Push(worker, branch.dest);
+        }
+
+        // Nothing falls through a jump, a return or an INT3
+        const INSTRUCTION_TYPE type = decoded.type;
+        if (type == INSTRUCTION_TYPE::UNC_JMP || type == INSTRUCTION_TYPE::RET
+            || (type == INSTRUCTION_TYPE::INT_CALL && decoded.opcode == 0xCC))
+            break;
+        current += decoded.length;
+    }
+}
+
+void Disassembler::findReferences(uint32_t addr, std::span<const uint8_t> instruction, const DecodedInstruction& decoded, AnalysisResult& result) const
+{
+    // An absolute address in the code is an operand the loader relocates
+    const auto check = [&](uint8_t offset, uint8_t size) {
+        if (size != 4 || !parser.IsRelocated(addr + offset, 4))
+            return;
+        const uint8_t* operand = instruction.data() + offset;
+        const uint32_t value = operand[0] | operand[1] << 8 | operand[2] << 16 | static_cast<uint32_t>(operand[3]) << 24;
+        if (value >= imageBase && isAddressInternal(value - imageBase))
+            result.references.emplace_back(skipNops(value - imageBase), addr);
+    };
+    check(decoded.dispOffset, decoded.dispSize);
+    check(decoded.immOffset, decoded.immSize);
+}
+
+void Disassembler::findDataReferences()
+{
+    // Pointers into the code stored outside any instruction (jump tables, vtables, callback
+    // tables) are relocated too; control can arrive there without an edge of the graph
+    for (const uint32_t rva : parser.GetRelocations().GetRelocatedAddresses()) {
+        const SectionHeader* section = parser.SectionOf(rva);
+        if (!section || rva + 4 > section->virtualAddress + section->virtualSize || referencedAddresses.Get(rva) == CODE)
+            continue;
+        uint32_t value;
+        std::memcpy(&value, VirtualImage + rva, sizeof(value));
+        if (value >= imageBase && isAddressInternal(value - imageBase))
+            references.emplace_back(skipNops(value - imageBase), rva);
+    }
+}
+
+std::span<const Branch> Disassembler::getCrossReferences(uint32_t addr) const
+{
+    return xrefs.BranchesTo(addr);
+}
+
+std::vector<uint32_t> Disassembler::getEntryBlocks() const
+{
+    std::vector<uint32_t> ids;
+    for (uint32_t id = 0; id < blocks.Size(); id++)
+        if (isEntryBlock(id))
+            ids.push_back(id);
+    return ids;
+}
+
+bool Disassembler::isEntryBlock(uint32_t id) const
+{
+    // Control can get there without an edge of the graph: the entry point, a call, or an address
+    // taken by an instruction or held in data. All of them start a block
+    const uint32_t start = blocks[id].start_address;
+    if (blocks.Find(entryPoint) == id || !xrefs.ReferencesTo(start).empty())
+        return true;
+    return std::ranges::any_of(xrefs.BranchesTo(start), [](const Branch& branch) { return branch.type == BRANCH_TYPE::CALL; });
+}
+
+std::vector<uint32_t> Disassembler::getExitBlocks() const
+{
+    std::vector<uint32_t> ids;
+    for (uint32_t id = 0; id < blocks.Size(); id++)
+        if (isExitBlock(id))
+            ids.push_back(id);
+    return ids;
+}
+
+bool Disassembler::isExitBlock(uint32_t id) const
+{
+    // The destinations are the ones the block was linked with, so a NOP run skipped on the way is skipped here too
+    auto last = code.lowerBound(blocks[id].end_address);
+    const InstructionStore::Instruction instruction = *--last;
+    std::vector<uint32_t> dest_addresses;
+    getBlockDestinations(instruction, dest_addresses);
+
+    // A jump whose destination isn't known, or goes through an import slot, leaves the graph
+    const INSTRUCTION_TYPE type = instruction.decoded.type;
+    if ((type == INSTRUCTION_TYPE::UNC_JMP && dest_addresses.empty()) || (type == INSTRUCTION_TYPE::C_JMP && dest_addresses.size() < 2))
+        return true;
+    return !std::ranges::all_of(dest_addresses, [&](uint32_t dest) {
+        return std::ranges::any_of(blocks.Successors(id), [&](uint32_t successor) { return blocks[successor].start_address == dest; });
+    });
+}
+
+bool Disassembler::hasCrossRefs(uint32_t addr) const
+{
+    return xrefs.IsReferenced(addr);
+}
+
+bool Disassembler::endsBlock(const DecodedInstruction& decoded)
+{
+    // Calls return to the next instruction, so they stay inside their block
+    switch (decoded.type) {
+    case INSTRUCTION_TYPE::C_JMP:
+    case INSTRUCTION_TYPE::UNC_JMP:
+    case INSTRUCTION_TYPE::RET:
+        return true;
+    case INSTRUCTION_TYPE::INT_CALL:
+        return decoded.opcode == 0xCC;
+    default:
+        return false;
+    }
+}
+
+void Disassembler::buildBlocks()
+{
+    blocks.Reset(codeStart, codeEnd);
+
+    // Blocks are read in address order, each one starting at the first reached instruction after the last
+    std::vector<uint32_t> dest_addresses;
+    for (size_t i = 0; i < code.size();) {
+        if (code.getFlags(i) & INSTRUCTION_SWEPT) {
+            i++;
+            continue;
+        }
+        dest_addresses.clear();
+        const Block block = readBlocks(code.getAddress(i), dest_addresses);
+        blocks.Add(block.start_address, block.end_address, dest_addresses);
+        i = code.lowerBound(block.end_address).getIndex();
+    }
+    blocks.Link();
+}
+
+Block Disassembler::readBlocks(uint32_t addr, std::vector<uint32_t>& dest_addresses)
+{
+    // Extend the block over contiguous instructions, until one ends it or another one is a branch target,
+    // a referenced address or the entry point
+    Block block{};
+    block.start_address = addr;
+    auto it = code.find(addr);
+    for (;;) {
+        const InstructionStore::Instruction instruction = *it;
+        const uint32_t next = instruction.end;
+        block.end_address = next;
+
+        if (endsBlock(instruction.decoded)) {
+            getBlockDestinations(instruction, dest_addresses);
+            break;
+        }
+
+        ++it;
+        if (it == code.end() || (*it).address != next || ((*it).flags & INSTRUCTION_SWEPT) || hasCrossRefs(next) || next == entryPoint || isAddrInBlock(next)) {
+            // Falls through into the next block, or off the decoded code
+            getBlockDestinations(instruction, dest_addresses);
+            break;
+        }
+    }
+    return block;
+}
+
+void Disassembler::getBlockDestinations(const InstructionStore::Instruction& last, std::vector<uint32_t>& dest_addresses) const
+{
+    // Where control goes after the last instruction of a block; readCode steps over NOP runs without storing them
+    const uint32_t next = skipNops(last.end);
+    if (!endsBlock(last.decoded)) {
+        dest_addresses.push_back(next);
+        return;
+    }
+    for (const Branch& branch : xrefs.BranchesFrom(last.address))
+        if (isCodeBranch(branch))
+            dest_addresses.push_back(branch.dest);
+    if (last.decoded.type == INSTRUCTION_TYPE::C_JMP)
+        dest_addresses.push_back(next);
+}
+
+void Disassembler::linkBlock(uint32_t id)
+{
+    std::vector<uint32_t> dest_addresses;
+    auto last = code.lowerBound(blocks[id].end_address);
+    getBlockDestinations(*--last, dest_addresses);
+    blocks.Relink(id, dest_addresses);
+}
+
+Block* Disassembler::getBlockOfAddr(uint32_t addr)
+{
+    const uint32_t id = blocks.Find(addr);
+    return id == BlockGraph::NoBlock ? nullptr : &blocks[id];
+}
+
+bool Disassembler::isAddrInBlock(const uint32_t addr) const
+{
+    return blocks.Find(addr) != BlockGraph::NoBlock;
+}
+
+bool Disassembler::isCodeBranch(const Branch& branch) const
+{
+    // The IAT can be merged into .text, so an import slot can look like internal code
+    return branch.dest && branch.type != BRANCH_TYPE::IMPORT_CALL && branch.type != BRANCH_TYPE::IMPORT_JMP
+        && isAddressInternal(branch.dest);
+}
+
+Block* Disassembler::splitBlock(uint32_t addr)
+{
+    const uint32_t id = blocks.Split(addr);
+    return id == BlockGraph::NoBlock ? nullptr : &blocks[id];
+}
+
+const CodeScan* Disassembler::getScan(uint32_t addr) const
+{
+    // There are only a handful of code ranges
+    for (const CodeScan& scan : scans)
+        if (scan.Contains(addr))
+            return &scan;
+    return nullptr;
+}
+
+uint32_t Disassembler::skipNops(uint32_t addr) const
+{
+    // Only the 0x90 bytes; CC or 00 filler right after them is a separate run that isn't executed
+    const CodeScan* scan = getScan(addr);
+    if (!scan || !scan->IsPadding(addr))
+        return addr;
+    while (addr < scan->GetEnd() && VirtualImage[addr] == 0x90)
+        addr++;
+    return addr;
+}
+
+bool Disassembler::claim(uint32_t addr)
+{
+    // Fails if the byte was already decoded, as the start or the middle of an instruction
+    const size_t offset = addr - codeStart;
+    const uint64_t bit = uint64_t{ 1 } << (offset % 64);
+    return !(visited[offset / 64].fetch_or(bit, std::memory_order_relaxed) & bit);
+}
+
+uint32_t Disassembler::findVisited(uint32_t addr, uint32_t end, bool state) const
+{
+    // First address of [addr, end) whose bit is state, a word at a time
+    size_t offset = addr - codeStart;
+    const size_t last = end - codeStart;
+    while (offset < last) {
+        const uint64_t word = visited[offset / 64].load(std::memory_order_relaxed);
+        const uint64_t bits = (state ? word : ~word) >> (offset % 64);
+        if (bits) {
+            offset += std::countr_zero(bits);
+            break;
+        }
+        offset = (offset / 64 + 1) * 64;
+    }
+    return codeStart + static_cast<uint32_t>(std::min(offset, last));
+}
+
+void Disassembler::markVisited(uint32_t addr, size_t size)
+{
+    for (size_t offset = addr - codeStart; offset < addr - codeStart + size; offset++)
+        visited[offset / 64].fetch_or(uint64_t{ 1 } << (offset % 64), std::memory_order_relaxed);
+}
+
+const char* Disassembler::generateOpCodeErrorInfo(const char* error, uint32_t addr)
+{
+    // Keep the message alive until the next error on this thread
+    thread_local std::string message;
+    char address[16];
+    snprintf(address, sizeof(address), "%08X", addr);
+    message = std::string(error) + " at RVA 0x" + address;
+    return message.c_str();
+}
+
+bool Disassembler::is_prefix(uint8_t op)
+{
+    return OneByteOpcodes[op].prefix;
+}
+
+std::span<const uint8_t> Disassembler::remove_prefixes(std::span<const uint8_t> instruction)
+{
+    // Skip the prefixes without copying the rest of the instruction
+    size_t i = 0;
+    while (i < instruction.size() && is_prefix(instruction[i]))
+        i++;
+    return instruction.subspan(i);
+}
+
+INSTRUCTION_TYPE Disassembler::getInstructionType(std::span<const uint8_t> instruction)
+{
+    DecodedInstruction decoded;
+    return decodeInstruction(instruction.data(), instruction.size(), decoded) ? decoded.type : INSTRUCTION_TYPE::OTHER;
+}
+
+OP_TYPE Disassembler::getOperandsType(std::span<const uint8_t> instruction)
+{
+    DecodedInstruction decoded;
+    return decodeInstruction(instruction.data(), instruction.size(), decoded) ? decoded.operands : OP_TYPE::OTHER;
+}
+
+uint8_t Disassembler::getInstructionLength(const uint8_t* code, size_t size)
+{
+    DecodedInstruction decoded;
+    return decodeInstruction(code, size, decoded) ? decoded.length : 0;
+}
+
+bool Disassembler::decodeInstruction(const uint8_t* code, size_t size, DecodedInstruction& decoded)
+{
+    decoded = {};
+
+    // An instruction can't be longer than 15 bytes
+    size = std::min<size_t>(size, 15);
+
+    // Prefixes
+    size_t i = 0;
+    while (i < size && OneByteOpcodes[code[i]].prefix) {
+        switch (code[i]) {
+        case 0xF0: decoded.prefixes |= PREFIX_LOCK; break;
+        case 0xF2: decoded.prefixes |= PREFIX_REPNE; break;
+        case 0xF3: decoded.prefixes |= PREFIX_REP; break;
+        case 0x66: decoded.prefixes |= PREFIX_OPERAND_SIZE; break;
+        case 0x67: decoded.prefixes |= PREFIX_ADDRESS_SIZE; break;
+        case 0x26: decoded.prefixes |= PREFIX_ES; break;
+        case 0x2E: decoded.prefixes |= PREFIX_CS; break;
+        case 0x36: decoded.prefixes |= PREFIX_SS; break;
+        case 0x3E: decoded.prefixes |= PREFIX_DS; break;
+        case 0x64: decoded.prefixes |= PREFIX_FS; break;
+        case 0x65: decoded.prefixes |= PREFIX_GS; break;
+        }
+        i++;
+    }
+    if (i >= size)
+        return false;
+    const bool operand_size = decoded.prefixes & PREFIX_OPERAND_SIZE;
+    const bool address_size = decoded.prefixes & PREFIX_ADDRESS_SIZE;
+    decoded.opcodeOffset = static_cast<uint8_t>(i);
+
+    // Opcode, going through the escapes to the two and three-byte maps
+    uint8_t opcode = code[i++];
+    OpcodeInfo info = OneByteOpcodes[opcode];
+
+    // VEX/EVEX: C4/C5/62 are LES/LDS/BOUND unless the next byte would be a register ModRM
+    if ((opcode == 0xC4 || opcode == 0xC5 || opcode == 0x62) && i < size && getMod(code[i]) == 3) {
+        // The 2-byte VEX form implies the 0F map, the others encode it in the first payload byte
+        const uint8_t map = opcode == 0xC5 ? 1 : code[i] & (opcode == 0x62 ? 0x03 : 0x1F);
+        i += opcode == 0xC5 ? 1 : opcode == 0xC4 ? 2 : 3;
+        if (i >= size || map < 1 || map > 3)
+            return false;
+        decoded.prefixes |= PREFIX_VEX;
+        decoded.map = static_cast<OPCODE_MAP>(map);
+        opcode = code[i++];
+        info = TwoByteOpcodes[opcode];
+        if (map != 1) {
+            // Every instruction of the 0F38 and 0F3A maps has a ModRM byte
+            info.modrm = true;
+            info.invalid = false;
+            info.imm = map == 3 ? IMM_TYPE::IB : IMM_TYPE::NONE;
+        }
+    }
+    else if (opcode == 0x0F) {
+        if (i >= size)
+            return false;
+        opcode = code[i++];
+        info = TwoByteOpcodes[opcode];
+        decoded.map = MAP_0F;
+        if (opcode == 0x38 || opcode == 0x3A) {
+            if (i >= size)
+                return false;
+            decoded.map = opcode == 0x38 ? MAP_0F38 : MAP_0F3A;
+            opcode = code[i++];
+        }
+    }
+    if (info.invalid)
+        return false;
+    decoded.opcode = opcode;
+
+    // ModRM, SIB and displacement
+    if (info.modrm) {
+        if (i >= size)
+            return false;
+        decoded.hasModrm = true;
+        decoded.modrm = code[i++];
+        const uint8_t mod = getMod(decoded.modrm), rm = getRM(decoded.modrm);
+
+        if (mod != 3) {
+            decoded.memoryOperand = true;
+            if (address_size) {
+                // 16-bit addressing has no SIB byte
+                if (mod == 1)
+                    decoded.dispSize = 1;
+                else if (mod == 2 || (mod == 0 && rm == 6))
+                    decoded.dispSize = 2;
+            }
+            else {
+                uint8_t base = rm;
+                if (rm == 4) {
+                    if (i >= size)
+                        return false;
+                    decoded.hasSib = true;
+                    decoded.sib = code[i++];
+                    base = getRM(decoded.sib);
+                }
+                if (mod == 1)
+                    decoded.dispSize = 1;
+                else if (mod == 2 || (mod == 0 && (rm == 5 || base == 5)))
+                    decoded.dispSize = 4;
+            }
+            decoded.dispOffset = static_cast<uint8_t>(i);
+            i += decoded.dispSize;
+        }
+    }
+
+    // Immediate
+    switch (info.imm) {
+    case IMM_TYPE::NONE:
+        break;
+    case IMM_TYPE::IB:
+        decoded.immSize = 1;
+        break;
+    case IMM_TYPE::IW:
+        decoded.immSize = 2;
+        break;
+    case IMM_TYPE::IZ:
+        decoded.immSize = operand_size ? 2 : 4;
+        break;
+    case IMM_TYPE::IWB:
+        decoded.immSize = 3;
+        break;
+    case IMM_TYPE::AP:
+        decoded.immSize = operand_size ? 4 : 6;
+        break;
+    case IMM_TYPE::MOFFS:
+        // The "immediate" is the address of the memory operand
+        decoded.memoryOperand = true;
+        decoded.immSize = address_size ? 2 : 4;
+        break;
+    case IMM_TYPE::GROUP3:
+        // Only TEST has an immediate, sized like IB for F6 and IZ for F7
+        if (getReg(decoded.modrm) < 2)
+            decoded.immSize = opcode == 0xF6 ? 1 : operand_size ? 2 : 4;
+        break;
+    }
+    decoded.immOffset = static_cast<uint8_t>(i);
+    i += decoded.immSize;
+    if (i > size)
+        return false;
+    decoded.length = static_cast<uint8_t>(i);
+
+    // Classification, from the tables plus the few cases that need the ModRM byte.
+    // The tables only describe the legacy one-byte and 0F maps.
+    if (decoded.map == MAP_ONE_BYTE || (decoded.map == MAP_0F && !(decoded.prefixes & PREFIX_VEX))) {
+        decoded.type = info.type;
+        decoded.operands = info.operands;
+    }
+    else {
+        decoded.type = INSTRUCTION_TYPE::OTHER;
+        decoded.operands = OP_TYPE::OTHER;
+    }
+    if (decoded.map == MAP_ONE_BYTE) {
+        const uint8_t mod = getMod(decoded.modrm), reg = getReg(decoded.modrm), rm = getRM(decoded.modrm);
+
+        // MOV/XCHG of a register with itself does nothing
+        if ((opcode == 0x89 || opcode == 0x8B || opcode == 0x87) && mod == 3 && reg == rm)
+            decoded.type = INSTRUCTION_TYPE::NOP;
+
+        // Group 5: the operation is selected by ModRM.reg
+        if (info.group) {
+            switch (reg) {
+            case 2:
+            case 3:
+                decoded.type = INSTRUCTION_TYPE::CALL;
+                break;
+            case 4:
+            case 5:
+                decoded.type = INSTRUCTION_TYPE::UNC_JMP;
+                break;
+            case 6:
+                decoded.type = INSTRUCTION_TYPE::STACK;
+                break;
+            default:
+                decoded.type = INSTRUCTION_TYPE::OTHER;
+                break;
+            }
+        }
+    }
+    computeRegisterEffects(decoded);
+    computeFlagEffects(decoded);
+    return true;
+}
+
+void Disassembler::computeRegisterEffects(DecodedInstruction& decoded)
+{
+    constexpr uint8_t ALL = 0xFF;
+    const auto bit = [](REGISTER reg) { return static_cast<uint8_t>(1 << static_cast<int>(reg)); };
+    const uint8_t eax = bit(REGISTER::EAX), ecx = bit(REGISTER::ECX), edx = bit(REGISTER::EDX),
+        ebx = bit(REGISTER::EBX), esp = bit(REGISTER::ESP), ebp = bit(REGISTER::EBP),
+        esi = bit(REGISTER::ESI), edi = bit(REGISTER::EDI);
+
+    uint8_t& read = decoded.regsRead;
+    uint8_t& written = decoded.regsWritten;
+    const uint8_t op = decoded.opcode;
+    const uint8_t mod = getMod(decoded.modrm), reg = getReg(decoded.modrm), rm = getRM(decoded.modrm);
+    const bool word = decoded.prefixes & PREFIX_OPERAND_SIZE;
+
+    // Registers used to compute the address of a memory operand
+    uint8_t address = 0;
+    if (decoded.hasModrm && mod != 3) {
+        if (decoded.prefixes & PREFIX_ADDRESS_SIZE) {
+            constexpr uint8_t bx = 1 << 3, bp = 1 << 5, si = 1 << 6, di = 1 << 7;
+            constexpr uint8_t modes[8] = { bx | si, bx | di, bp | si, bp | di, si, di, bp, bx };
+            address = mod == 0 && rm == 6 ? 0 : modes[rm];
+        }
+        else if (decoded.hasSib) {
+            const uint8_t base = getRM(decoded.sib), index = getReg(decoded.sib);
+            if (!(mod == 0 && base == 5))
+                address |= 1 << base;
+            if (index != 4)
+                address |= 1 << index;
+        }
+        else if (!(mod == 0 && rm == 5))
+            address = 1 << rm;
+    }
+    read |= address;
+
+    // Byte registers 4-7 are AH..BH, the high halves of EAX..EBX
+    const auto gpr = [](uint8_t r, bool byte) { return static_cast<uint8_t>(1 << (byte ? r & 3 : r)); };
+    // Writing part of a register keeps the rest of it, so it is also a read
+    const auto write = [&](uint8_t mask, bool partial) {
+        written |= mask;
+        if (partial)
+            read |= mask;
+    };
+    // The ModRM.rm operand, when it is a register
+    const auto e = [&](bool byte) { return mod == 3 ? gpr(rm, byte) : static_cast<uint8_t>(0); };
+    const auto g = [&](bool byte) { return gpr(reg, byte); };
+
+    if (decoded.prefixes & PREFIX_VEX) {
+        // Only BMI1/BMI2 (F0-F7 of the 0F38/0F3A maps) use general purpose registers;
+        // other vector instructions only use them to address memory
+        if (decoded.map != MAP_0F && op >= 0xF0 && op <= 0xF7) {
+            read |= ALL;
+            written |= ALL;
+        }
+        return;
+    }
+
+    if (decoded.map == MAP_ONE_BYTE) {
+        if (op < 0x40 && (op & 7) < 6) {
+            // ADD/OR/ADC/SBB/AND/SUB/XOR/CMP
+            const bool byte = !(op & 1), cmp = op >= 0x38;
+            const bool partial = byte || word;
+            switch (op & 7) {
+            case 0: case 1: read |= e(byte) | g(byte); if (!cmp) write(e(byte), partial); break;
+            case 2: case 3: read |= e(byte) | g(byte); if (!cmp) write(g(byte), partial); break;
+            case 4: case 5: read |= eax; if (!cmp) write(eax, partial); break;
+            }
+            return;
+        }
+
+        switch (op) {
+        case 0x06: case 0x0E: case 0x16: case 0x1E: // PUSH/POP segment
+        case 0x07: case 0x17: case 0x1F:
+        case 0x68: case 0x6A: case 0x9C: case 0x9D: // PUSH imm, PUSHF/POPF
+            read |= esp; written |= esp; return;
+        case 0x27: case 0x2F: case 0x37: case 0x3F: // BCD adjustments
+        case 0x98: case 0x9E: case 0x9F: case 0xD4: case 0xD5: case 0xD6:
+            read |= eax; written |= eax; return;
+        case 0x60: case 0x61: // PUSHA/POPA
+            read |= ALL; written |= ALL; return;
+        case 0x69: case 0x6B: // IMUL Gv, Ev, imm
+            read |= e(false); write(g(false), word); return;
+        case 0x80: case 0x81: case 0x82: case 0x83:
+            read |= e(op == 0x80 || op == 0x82);
+            if (reg != 7)
+                write(e(op == 0x80 || op == 0x82), op == 0x80 || op == 0x82 || word);
+            return;
+        case 0x84: case 0x85: // TEST
+            read |= e(op == 0x84) | g(op == 0x84); return;
+        case 0x86: case 0x87: // XCHG
+            read |= e(op == 0x86) | g(op == 0x86); written |= e(op == 0x86) | g(op == 0x86); return;
+        case 0x88: case 0x89: // MOV Ev, Gv
+            read |= g(op == 0x88); write(e(op == 0x88), op == 0x88 || word); return;
+        case 0x8A: case 0x8B: // MOV Gv, Ev
+            read |= e(op == 0x8A); write(g(op == 0x8A), op == 0x8A || word); return;
+        case 0x8C: // MOV Ev, Sw
+            write(e(false), true); return;
+        case 0x8D: // LEA
+            write(g(false), word); return;
+        case 0x8E: // MOV Sw, Ew
+            read |= e(false); return;
+        case 0x8F: // POP Ev
+            read |= esp; written |= esp | e(false); return;
+        case 0x90: // NOP
+            return;
+        case 0x99: // CDQ
+            read |= eax; written |= edx; return;
+        case 0xA0: case 0xA1: // MOV eAX, moffs
+            write(eax, op == 0xA0 || word); return;
+        case 0xA2: case 0xA3: // MOV moffs, eAX
+        case 0xA8: case 0xA9: // TEST eAX, imm
+            read |= eax; return;
+        case 0xA4: case 0xA5: case 0xA6: case 0xA7: // string instructions
+        case 0xAA: case 0xAB: case 0xAC: case 0xAD: case 0xAE: case 0xAF:
+            read |= eax | ecx | esi | edi; written |= eax | ecx | esi | edi; return;
+        case 0xC0: case 0xC1: case 0xD0: case 0xD1: case 0xD2: case 0xD3: // shifts and rotations
+            read |= e(!(op & 1)) | (op >= 0xD2 ? ecx : 0);
+            write(e(!(op & 1)), !(op & 1) || word);
+            return;
+        case 0xC6: case 0xC7: // MOV Ev, imm
+            write(e(op == 0xC6), op == 0xC6 || word); return;
+        case 0xC8: case 0xC9: // ENTER/LEAVE
+            read |= esp | ebp; written |= esp | ebp; return;
+        case 0xD7: // XLAT
+            read |= eax | ebx; written |= eax; return;
+        case 0xE0: case 0xE1: case 0xE2: case 0xE3: // LOOPcc/JECXZ
+            read |= ecx; written |= op != 0xE3 ? ecx : 0; return;
+        case 0xE4: case 0xE5: case 0xEC: case 0xED: // IN
+            read |= op >= 0xEC ? edx : 0; write(eax, true); return;
+        case 0xE6: case 0xE7: case 0xEE: case 0xEF: // OUT
+            read |= eax | (op >= 0xEE ? edx : 0); return;
+        case 0xE9: case 0xEB: case 0xEA: // JMP
+            return;
+        case 0xF6: case 0xF7: // group 3
+            switch (reg) {
+            case 0: case 1: read |= e(op == 0xF6); return; // TEST
+            case 2: case 3: read |= e(op == 0xF6); write(e(op == 0xF6), op == 0xF6 || word); return; // NOT/NEG
+            default: // MUL/IMUL/DIV/IDIV
+                read |= e(op == 0xF6) | eax | (op == 0xF7 && reg >= 6 ? edx : 0);
+                written |= eax | (op == 0xF7 ? edx : 0);
+                return;
+            }
+        case 0xF8: case 0xF9: case 0xFA: case 0xFB: case 0xFC: case 0xFD: case 0xF5: case 0xF4: // flags, HLT
+            return;
+        case 0xFE: // INC/DEC Eb
+            read |= e(true); write(e(true), true); return;
+        case 0xFF: // group 5
+            switch (reg) {
+            case 0: case 1: read |= e(false); write(e(false), word); return; // INC/DEC
+            case 4: case 5: read |= e(false); return; // JMP
+            case 6: read |= e(false) | esp; written |= esp; return; // PUSH
+            default: break; // CALL: handled with the other calls
+            }
+            break;
+        }
+
+        if (op >= 0x40 && op <= 0x4F) { // INC/DEC r32
+            read |= 1 << (op & 7); written |= 1 << (op & 7); return;
+        }
+        if (op >= 0x50 && op <= 0x57) { // PUSH r32
+            read |= (1 << (op & 7)) | esp; written |= esp; return;
+        }
+        if (op >= 0x58 && op <= 0x5F) { // POP r32
+            read |= esp; written |= (1 << (op & 7)) | esp; return;
+        }
+        if (op >= 0x70 && op <= 0x7F) // Jcc
+            return;
+        if (op >= 0x91 && op <= 0x97) { // XCHG eAX, r32
+            read |= eax | 1 << (op & 7); written |= eax | 1 << (op & 7); return;
+        }
+        if (op >= 0xB0 && op <= 0xB7) { // MOV r8, imm
+            write(gpr(op & 7, true), true); return;
+        }
+        if (op >= 0xB8 && op <= 0xBF) { // MOV r32, imm
+            write(1 << (op & 7), word); return;
+        }
+        if (op >= 0xD8 && op <= 0xDF) // x87, only the address registers
+            return;
+    }
+    else if (decoded.map == MAP_0F) {
+        if (op >= 0x40 && op <= 0x4F) { // CMOVcc
+            read |= e(false) | g(false); written |= g(false); return;
+        }
+        if (op >= 0x80 && op <= 0x8F) // Jcc
+            return;
+        if (op >= 0x90 && op <= 0x9F) { // SETcc
+            write(e(true), true); return;
+        }
+        if (op >= 0xC8 && op <= 0xCF) { // BSWAP
+            read |= 1 << (op & 7); written |= 1 << (op & 7); return;
+        }
+        if (op >= 0x18 && op <= 0x1F) // hint NOPs
+            return;
+
+        switch (op) {
+        case 0x31: // RDTSC
+            written |= eax | edx; return;
+        case 0xA2: // CPUID
+            read |= eax | ecx; written |= eax | ebx | ecx | edx; return;
+        case 0xA0: case 0xA1: case 0xA8: case 0xA9: // PUSH/POP FS/GS
+            read |= esp; written |= esp; return;
+        case 0xA3: // BT
+            read |= e(false) | g(false); return;
+        case 0xAB: case 0xB3: case 0xBB: // BTS/BTR/BTC
+            read |= e(false) | g(false); written |= e(false); return;
+        case 0xA4: case 0xA5: case 0xAC: case 0xAD: // SHLD/SHRD
+            read |= e(false) | g(false) | (op & 1 ? ecx : 0); written |= e(false); return;
+        case 0xAF: // IMUL Gv, Ev
+            read |= e(false) | g(false); written |= g(false); return;
+        case 0xB0: case 0xB1: // CMPXCHG
+            read |= e(op == 0xB0) | g(op == 0xB0) | eax; written |= e(op == 0xB0) | eax; return;
+        case 0xB6: case 0xB7: case 0xBE: case 0xBF: // MOVZX/MOVSX
+        case 0xBC: case 0xBD: case 0xB8: // BSF/BSR/POPCNT
+            read |= e(op == 0xB6 || op == 0xBE); write(g(false), word || op == 0xBC || op == 0xBD); return;
+        case 0xC0: case 0xC1: // XADD
+            read |= e(op == 0xC0) | g(op == 0xC0); written |= e(op == 0xC0) | g(op == 0xC0); return;
+        }
+    }
+
+    // Calls, returns, interrupts and anything not modelled above: assume every register is used
+    read |= ALL;
+    written |= ALL;
+}
+
+void Disassembler::computeFlagEffects(DecodedInstruction& decoded)
+{
+    uint8_t& read = decoded.flagsRead;
+    uint8_t& written = decoded.flagsWritten;
+    const uint8_t op = decoded.opcode;
+    const uint8_t mod = getMod(decoded.modrm), reg = getReg(decoded.modrm);
+
+    // Flags tested by the condition code of Jcc, SETcc and CMOVcc
+    constexpr uint8_t conditions[8] = { FLAG_OF, FLAG_CF, FLAG_ZF, FLAG_CF | FLAG_ZF, FLAG_SF, FLAG_PF,
+        FLAG_SF | FLAG_OF, FLAG_ZF | FLAG_SF | FLAG_OF };
+    const uint8_t condition = conditions[(op & 0xF) >> 1];
+    // Instructions that may leave the flags as they were (a count of 0) pass them through
+    const auto maybe = [&](uint8_t flags) {
+        read |= flags;
+        written |= flags;
+    };
+
+    if (decoded.prefixes & PREFIX_VEX) {
+        // BMI (ANDN, BLSR/BLSMSK/BLSI, BZHI, BEXTR) set the flags, the shifts and MULX/PDEP/PEXT don't;
+        // the VEX prefix bytes that tell them apart aren't kept
+        if (decoded.map == MAP_0F38 && op >= 0xF2 && op <= 0xF7)
+            maybe(FLAGS_ALL);
+        else if (decoded.map == MAP_0F38 && (op == 0x0E || op == 0x0F || op == 0x17)) // VTESTPS/PD, VPTEST
+            written |= FLAGS_ALL;
+        return;
+    }
+
+    if (decoded.map == MAP_ONE_BYTE) {
+        if (op < 0x40 && (op & 7) < 6) {
+            // ADD/OR/ADC/SBB/AND/SUB/XOR/CMP
+            written |= FLAGS_ALL;
+            if ((op >> 3) == 2 || (op >> 3) == 3)
+                read |= FLAG_CF;
+            return;
+        }
+        if (op >= 0x40 && op <= 0x4F) { // INC/DEC keep CF
+            written |= FLAGS_ALL & ~FLAG_CF;
+            return;
+        }
+        if (op >= 0x70 && op <= 0x7F) { // Jcc
+            read |= condition;
+            return;
+        }
+
+        switch (op) {
+        case 0x27: case 0x2F: // DAA/DAS
+            read |= FLAG_CF | FLAG_AF; written |= FLAGS_ALL; return;
+        case 0x37: case 0x3F: // AAA/AAS
+            read |= FLAG_AF; written |= FLAGS_ALL; return;
+        case 0x69: case 0x6B: case 0x84: case 0x85: case 0xA8: case 0xA9: // IMUL, TEST
+        case 0xD4: case 0xD5: // AAM/AAD
+        case 0xCC: case 0xCD: case 0xCF: // INT3, INT, IRET
+            written |= FLAGS_ALL; return;
+        case 0xCE: // INTO
+            read |= FLAG_OF; written |= FLAGS_ALL; return;
+        case 0x80: case 0x81: case 0x82: case 0x83:
+            written |= FLAGS_ALL;
+            if (reg == 2 || reg == 3)
+                read |= FLAG_CF;
+            return;
+        case 0x9C: // PUSHF
+            read |= FLAGS_ALL; return;
+        case 0x9F: // LAHF
+            read |= FLAGS_ALL & ~FLAG_OF; return;
+        case 0x9D: // POPF
+            written |= FLAGS_ALL; return;
+        case 0x9E: // SAHF
+            written |= FLAGS_ALL & ~FLAG_OF; return;
+        case 0xA6: case 0xA7: case 0xAE: case 0xAF: // CMPS/SCAS, which REP may run no times
+            if (decoded.prefixes & (PREFIX_REP | PREFIX_REPNE))
+                maybe(FLAGS_ALL);
+            else
+                written |= FLAGS_ALL;
+            return;
+        case 0xC0: case 0xC1: case 0xD2: case 0xD3: case 0xD0: case 0xD1: {
+            // Rotations only change CF and OF, RCL/RCR also read CF; a count of 0 changes nothing
+            const uint8_t flags = reg < 4 ? FLAG_CF | FLAG_OF : FLAGS_ALL;
+            if (op == 0xD0 || op == 0xD1)
+                written |= flags;
+            else
+                maybe(flags);
+            if (reg == 2 || reg == 3)
+                read |= FLAG_CF;
+            return;
+        }
+        case 0xD6: // SALC
+            read |= FLAG_CF; return;
+        case 0xDA: case 0xDB: // FCMOVcc, FUCOMI/FCOMI
+            if (mod == 3 && reg < 4)
+                read |= FLAG_CF | FLAG_ZF | FLAG_PF;
+            else if (op == 0xDB && mod == 3 && (reg == 5 || reg == 6))
+                written |= FLAGS_ALL;
+            return;
+        case 0xDF: // FUCOMIP/FCOMIP
+            if (mod == 3 && (reg == 5 || reg == 6))
+                written |= FLAGS_ALL;
+            return;
+        case 0xE0: case 0xE1: // LOOPNE/LOOPE
+            read |= FLAG_ZF; return;
+        case 0xF5: // CMC
+            read |= FLAG_CF; written |= FLAG_CF; return;
+        case 0xF8: case 0xF9: // CLC/STC
+            written |= FLAG_CF; return;
+        case 0xF6: case 0xF7: // group 3: only NOT leaves the flags alone
+            if (reg != 2)
+                written |= FLAGS_ALL;
+            return;
+        case 0xFE: case 0xFF: // INC/DEC keep CF
+            if (reg < 2)
+                written |= FLAGS_ALL & ~FLAG_CF;
+            else if (reg == 2 || reg == 3) // calls don't preserve the flags
+                written |= FLAGS_ALL;
+            return;
+        case 0xE8: case 0x9A: // CALL
+            written |= FLAGS_ALL; return;
+        }
+        return;
+    }
+
+    if (decoded.map == MAP_0F) {
+        if (op >= 0x40 && op <= 0x4F) { // CMOVcc
+            read |= condition;
+            return;
+        }
+        if (op >= 0x80 && op <= 0x9F) { // Jcc, SETcc
+            read |= condition;
+            return;
+        }
+
+        switch (op) {
+        case 0x02: case 0x03: case 0x00: // LAR/LSL, VERR/VERW
+            if (op != 0x00 || reg == 4 || reg == 5)
+                written |= FLAG_ZF;
+            return;
+        case 0x2E: case 0x2F: // UCOMISS/COMISS
+        case 0xA3: case 0xAB: case 0xB3: case 0xBB: case 0xBA: // BT/BTS/BTR/BTC
+        case 0xAF: case 0xB0: case 0xB1: case 0xC0: case 0xC1: // IMUL, CMPXCHG, XADD
+        case 0xB8: case 0xBC: case 0xBD: // POPCNT, BSF/BSR (TZCNT/LZCNT)
+        case 0x34: case 0x35: // SYSENTER/SYSEXIT
+            written |= FLAGS_ALL; return;
+        case 0xC7: // CMPXCHG8B
+            if (reg == 1)
+                written |= FLAG_ZF;
+            else if (reg == 6 || reg == 7) // RDRAND/RDSEED
+                written |= FLAGS_ALL;
+            return;
+        case 0xA4: case 0xA5: case 0xAC: case 0xAD: // SHLD/SHRD
+            maybe(FLAGS_ALL); return;
+        }
+        return;
+    }
+
+    // 0F38/0F3A: PTEST and ADCX/ADOX set flags, and the string compares of 0F3A 60-63
+    if ((decoded.map == MAP_0F38 && (op == 0x17 || op == 0xF6)) || (decoded.map == MAP_0F3A && op >= 0x60 && op <= 0x63))
+        maybe(FLAGS_ALL);
+}
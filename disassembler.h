@@ -3,13 +3,24 @@
 #ifndef DECOMPILER_H
 #define DECOMPILER_H
 
+#include <atomic>
 #include <vector>
-#include <map>
 #include <set>
 #include <cstdint>
 #include <cstddef>
+#include <span>
 
 #include "PEParser.h"
+#include "block_graph.h"
+#include "classification.h"
+#include "code_scan.h"
+#include "decoded_instruction.h"
+#include "instruction_store.h"
+#include "liveness.h"
+#include "patch_overlay.h"
+#include "register_values.h"
+#include "work_queue.h"
+#include "xref_index.h"
 
 enum class REGISTER
 {
@@ -24,15 +35,7 @@ enum class REGISTER
 	NONE
 };
 
-enum DETECTED_TYPE
-{
-	CODE,
-	DATA,
-	POSSIBLE_DATA, // this could be data; shouldn't disassemble it
-	UNKNOWN
-};
-
-enum class INSTRUCTION_TYPE
+enum class INSTRUCTION_TYPE : uint8_t
 {
 	OTHER, // instruction that doesn't have its own code
 	NOP, // instructions that do nothing, not necesasrily 0x90
@@ -45,7 +48,7 @@ enum class INSTRUCTION_TYPE
 	STACK // PUSH, POP
 };
 
-enum class OP_TYPE
+enum class OP_TYPE : uint8_t
 {
 	OTHER,
 	NONE,
@@ -60,12 +63,14 @@ enum class OP_TYPE
 
 enum class BRANCH_TYPE
 {
-	JMP,
+	JMP, // relative, the destination is known from the instruction
 	COND_JMP,
 	CALL,
-	REGULAR_JMP,
+	REGULAR_JMP, // through a register or memory, the destination is unknown
 	REGULAR_COND_JMP,
-	REGULAR_CALL
+	REGULAR_CALL,
+	IMPORT_JMP, // through an IAT slot: the destination is the slot, which names the imported function
+	IMPORT_CALL
 };
 
 struct Branch
@@ -75,22 +80,6 @@ struct Branch
 	uint32_t dest;
 };
 
-struct BlockRegister
-{
-	int32_t value{ NULL };
-	bool modified{ false };
-	bool is_value_known = false;
-	bool inherited_value = false;
-};
-
-struct Block
-{
-	uint32_t start_address;
-	uint32_t end_address;
-	std::vector<uint32_t>& dest_addresses;
-	Block():start_address{},end_address{},dest_addresses( *(new std::vector<uint32_t>) ){}
-};
-
 uint8_t getMod(uint8_t modrm);
 uint8_t getReg(uint8_t modrm);
 uint8_t getRM(uint8_t modrm);
@@ -99,38 +88,85 @@ class Disassembler
 {
 public:
 	Disassembler(PEParser& parser);
-	void analyze(); // build the branches and blocks vectors
-	const std::map<uint32_t, std::vector<uint8_t>>& getCode();
-	void editInstruction(uint32_t addr, std::vector < uint8_t > instruction);
-	static INSTRUCTION_TYPE getInstructionType(const std::vector<uint8_t>& instruction);
-	static OP_TYPE getOperandsType(const std::vector<uint8_t>& instruction);
-	static std::vector<uint8_t> remove_prefixes(const std::vector<uint8_t>& instruction);
-	uint32_t getBranchDestination(uint32_t addr, std::vector<uint8_t>& instruction);
+	void analyze(unsigned threads = 0); // build the branches and blocks vectors, on every core by default
+	void sweep(unsigned threads = 0); // linear sweep of what analyze() didn't reach
+	const InstructionStore& getCode() const;
+	const BlockGraph& getBlocks() const;
+	void editInstruction(uint32_t addr, std::span<const uint8_t> instruction);
+	void reanalyze(); // update the branches and blocks around the edits since the last analysis
+	void discardEdits(); // drop the edits that weren't written to the image
+	void reorderInstructions(uint32_t addr, std::span<const uint32_t> order); // lay out the contiguous run at addr in the given order
+	static INSTRUCTION_TYPE getInstructionType(std::span<const uint8_t> instruction);
+	static OP_TYPE getOperandsType(std::span<const uint8_t> instruction);
+	static std::span<const uint8_t> remove_prefixes(std::span<const uint8_t> instruction);
+	static uint8_t getInstructionLength(const uint8_t* code, size_t size);
+	static bool decodeInstruction(const uint8_t* code, size_t size, DecodedInstruction& decoded);
+	static uint32_t getBranchDestination(uint32_t addr, std::span<const uint8_t> instruction, const DecodedInstruction& decoded);
+	bool getBranch(uint32_t addr, std::span<const uint8_t> instruction, const DecodedInstruction& decoded, Branch& branch) const;
+	uint32_t getImportSlot(std::span<const uint8_t> instruction, const DecodedInstruction& decoded) const; // 0 unless call/jmp [IAT slot]
+	uint32_t getBranchDestination(uint32_t addr) const; // also JMP reg, when the register value is known
+	const ImportedFunction* getImport(uint32_t addr) const; // what a call or jump through the IAT at addr goes to
+	bool hasCrossRefs(uint32_t addr) const; // something branches to addr or holds its address
+	RegisterMask getLiveAfter(uint32_t addr) const; // registers and flags read after the instruction before being written
 	void addOpCodes(std::vector<uint8_t>& instruction, uint32_t addr, unsigned count);
 	static bool is_prefix(uint8_t op);
-	bool isAddressInternal(uint32_t address);
+	bool isAddressInternal(uint32_t address) const;
 	void UpdateVirtualImageFromInstructions();
 protected:
-	uint8_t readInstruction(uint32_t addr);
-	void readCode(uint32_t addr);
-	const char* generateOpCodeErrorInfo(const char* error, uint32_t addr);
-	Block readBlocks(uint32_t addr);
-	void analyzeBlock(Block& block);
-	std::vector<Branch> getCrossReferences(uint32_t addr);
-	bool hasCrossRefs(uint32_t addr);
+	// What one analysis thread found, merged into the disassembler once they're all done
+	struct AnalysisResult
+	{
+		InstructionStore code;
+		std::vector<Branch> branches;
+		std::vector<std::pair<uint32_t, uint32_t>> references;
+	};
+
+	DecodedInstruction readInstruction(uint32_t addr) const;
+	void readCode(uint32_t addr, WorkQueue& queue, size_t worker, AnalysisResult& result);
+	static const char* generateOpCodeErrorInfo(const char* error, uint32_t addr);
+	Block readBlocks(uint32_t addr, std::vector<uint32_t>& dest_addresses);
+	std::span<const Branch> getCrossReferences(uint32_t addr) const;
+	std::vector<uint32_t> getEntryBlocks() const;
+	bool isEntryBlock(uint32_t id) const; // reached from outside the block graph
+	std::vector<uint32_t> getExitBlocks() const;
+	bool isExitBlock(uint32_t id) const; // control can go from it to somewhere that doesn't start a successor
 	Block* getBlockOfAddr(uint32_t addr);
-	bool isAddrInBlock(const uint32_t addr);
+	bool isAddrInBlock(const uint32_t addr) const;
+	bool isCodeBranch(const Branch& branch) const; // control goes to branch.dest, in this image; an import slot is only read
+	Block* splitBlock(uint32_t addr);
+	void buildBlocks();
+	void getBlockDestinations(const InstructionStore::Instruction& last, std::vector<uint32_t>& dest_addresses) const;
+	void linkBlock(uint32_t id);
+	static bool endsBlock(const DecodedInstruction& decoded);
+	static void computeRegisterEffects(DecodedInstruction& decoded);
+	static void computeFlagEffects(DecodedInstruction& decoded);
+	const CodeScan* getScan(uint32_t addr) const;
+	uint32_t skipNops(uint32_t addr) const; // past the NOP run at addr, if there is one
+	bool claim(uint32_t addr);
+	void markVisited(uint32_t addr, size_t size);
+	void findReferences(uint32_t addr, std::span<const uint8_t> instruction, const DecodedInstruction& decoded, AnalysisResult& result) const;
+	void findDataReferences(); // relocated pointers into the code outside the decoded instructions
+	uint32_t findVisited(uint32_t addr, uint32_t end, bool state) const;
 private:
 	PEParser& parser;
 	uint8_t*& VirtualImage;
+	PatchOverlay patches; // edits not written to the virtual image yet
 	std::vector<std::pair<uint32_t, uint32_t>> code_bounds;
+	std::vector<CodeScan> scans; // one per code range, built by analyze()
+	uint32_t codeStart; // lowest and highest address of the code ranges
+	uint32_t codeEnd;
+	std::vector<std::atomic<uint64_t>> visited; // bit per byte from codeStart already decoded
 	uint32_t imageBase;
 	uint32_t entryPoint;
-	std::map<uint32_t, std::vector<uint8_t>> code;
+	InstructionStore code;
 	std::vector<Branch> branches;
-	std::vector<Block> blocks;
-	std::map<uint32_t, DETECTED_TYPE> referencedAddresses;
-	std::multimap < uint32_t, uint32_t > references;
+	BlockGraph blocks;
+	ByteClassification referencedAddresses; // over the code bounds
+	std::vector<std::pair<uint32_t, uint32_t>> references; // destination and source of relocated operands and data pointing into code, by source
+	XrefIndex xrefs; // branches and references, indexed once analyze() is done
+	std::vector<uint32_t> edits; // addresses edited since the last analysis
+	RegisterValues registerValues; // at the end of every block
+	Liveness liveness; // after every instruction in a block
 	uint32_t startOfEntrySection;
 };
 
@@ -0,0 +1,119 @@
+#include "image_arena.h"
+
+#include <Windows.h>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+    constexpr size_t PageSize = 0x1000;
+    constexpr size_t ReservationGranularity = 0x10000;
+    constexpr size_t MinHeadroom = 0x1000000; // room for a decryptor and a few grown sections
+
+    size_t AlignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+ImageArena::ImageArena(size_t size, bool large_pages) :
+    size(size)
+{
+    // Large pages need the SeLockMemoryPrivilege and can't be committed lazily, so the
+    // headroom is committed with the image, though only the fixed amount; fall back to
+    // regular pages without them
+    if (const size_t large_page = GetLargePageMinimum(); large_pages && large_page && size >= large_page)
+    {
+        reserved = committed = AlignUp(size + MinHeadroom, large_page);
+        base = static_cast<uint8_t*>(VirtualAlloc(nullptr, reserved,
+            MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
+        largePages = base != nullptr;
+    }
+
+    if (!base)
+    {
+        // Reserve room to grow, but only commit what is needed now. Committed pages
+        // are zero-filled on first access, so there is nothing to clear
+        reserved = AlignUp(size + std::max(size, MinHeadroom), ReservationGranularity);
+        committed = AlignUp(std::max<size_t>(size, 1), PageSize);
+        base = static_cast<uint8_t*>(VirtualAlloc(nullptr, reserved, MEM_RESERVE, PAGE_NOACCESS));
+        if (base && !VirtualAlloc(base, committed, MEM_COMMIT, PAGE_READWRITE))
+        {
+            VirtualFree(base, 0, MEM_RELEASE);
+            base = nullptr;
+        }
+    }
+
+    if (!base)
+        throw std::runtime_error("Could not allocate memory for the virtual image.");
+}
+
+ImageArena::~ImageArena()
+{
+    Release();
+}
+
+ImageArena::ImageArena(ImageArena&& other) noexcept :
+    base(std::exchange(other.base, nullptr)), size(std::exchange(other.size, 0)),
+    reserved(std::exchange(other.reserved, 0)), committed(std::exchange(other.committed, 0)),
+    largePages(std::exchange(other.largePages, false))
+{
+}
+
+ImageArena& ImageArena::operator = (ImageArena&& other) noexcept
+{
+    if (this != &other)
+    {
+        Release();
+        base = std::exchange(other.base, nullptr);
+        size = std::exchange(other.size, 0);
+        reserved = std::exchange(other.reserved, 0);
+        committed = std::exchange(other.committed, 0);
+        largePages = std::exchange(other.largePages, false);
+    }
+    return *this;
+}
+
+uint8_t* ImageArena::GetData() const
+{
+    return base;
+}
+
+size_t ImageArena::GetSize() const
+{
+    return size;
+}
+
+void ImageArena::Resize(size_t new_size)
+{
+    // The tail of the last page is already committed and zeroed
+    if (new_size <= committed)
+    {
+        size = new_size;
+        return;
+    }
+
+    // Commit the missing pages in place while the reservation lasts
+    if (new_size <= reserved && !largePages)
+    {
+        const size_t new_committed = AlignUp(new_size, PageSize);
+        if (!VirtualAlloc(base + committed, new_committed - committed, MEM_COMMIT, PAGE_READWRITE))
+            throw std::runtime_error("Could not commit memory for the virtual image.");
+        committed = new_committed;
+        size = new_size;
+        return;
+    }
+
+    // Out of headroom: move the image to a bigger reservation, which comes with headroom of its own
+    ImageArena bigger(new_size, largePages);
+    std::copy_n(base, size, bigger.base);
+    *this = std::move(bigger);
+}
+
+void ImageArena::Release()
+{
+    if (base)
+        VirtualFree(base, 0, MEM_RELEASE);
+    base = nullptr;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#ifndef IMAGE_ARENA_H
+#define IMAGE_ARENA_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Page-aligned buffer holding a whole mapped image.
+// The memory comes straight from VirtualAlloc, so pages that are never
+// written (uninitialized data) stay zero-filled without being touched.
+// Address space is reserved with headroom and committed on demand, so the
+// buffer grows in place and pointers into it stay valid while it does.
+// Large pages are committed up front, with a fixed headroom; growing past
+// it moves the buffer.
+class ImageArena
+{
+public:
+	ImageArena() = default;
+	explicit ImageArena(size_t size, bool large_pages = false);
+	~ImageArena();
+	ImageArena(const ImageArena&) = delete;
+	void operator = (const ImageArena&) = delete;
+	ImageArena(ImageArena&& other) noexcept;
+	ImageArena& operator = (ImageArena&& other) noexcept;
+
+	uint8_t* GetData() const;
+	size_t GetSize() const;
+	void Resize(size_t size);
+private:
+	void Release();
+
+	uint8_t* base{};
+	size_t size{};
+	size_t reserved{};
+	size_t committed{};
+	bool largePages{};
+};
+
+#endif
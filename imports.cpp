@@ -0,0 +1,98 @@
+#include "imports.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+#include "PEFormat.h"
+
+namespace
+{
+    constexpr uint32_t OrdinalFlag = 0x80000000;
+
+    // Read a NUL terminated string at an RVA without running off the image
+    std::string ReadString(const uint8_t* image, size_t image_size, uint32_t rva)
+    {
+        if (rva >= image_size)
+            throw std::runtime_error("Import name out of bounds.");
+        const char* start = reinterpret_cast<const char*>(image + rva);
+        return { start, strnlen(start, image_size - rva) };
+    }
+
+    uint32_t ReadDword(const uint8_t* image, size_t image_size, size_t rva)
+    {
+        if (rva + sizeof(uint32_t) > image_size)
+            throw std::runtime_error("Import thunk out of bounds.");
+        uint32_t value;
+        std::memcpy(&value, image + rva, sizeof(value));
+        return value;
+    }
+}
+
+ImportTable::ImportTable(const uint8_t* image, size_t image_size, uint32_t directory_rva, uint32_t directory_size)
+{
+    // Check that the directory lies within the image
+    if (static_cast<size_t>(directory_rva) + directory_size > image_size)
+        throw std::runtime_error("Import directory out of bounds.");
+
+    // The descriptors end with an all-zero entry
+    for (size_t offset = directory_rva; offset + sizeof(ImportDescriptor) <= image_size; offset += sizeof(ImportDescriptor)) {
+        ImportDescriptor descriptor;
+        std::memcpy(&descriptor, image + offset, sizeof(descriptor));
+        if (!descriptor.name && !descriptor.firstThunk)
+            break;
+
+        dlls.push_back(ReadString(image, image_size, descriptor.name));
+        const uint32_t dll = static_cast<uint32_t>(dlls.size() - 1);
+
+        // Bound imports overwrite the IAT on disk, so prefer the lookup table when there is one
+        const uint32_t lookup = descriptor.originalFirstThunk ? descriptor.originalFirstThunk : descriptor.firstThunk;
+        const auto first = static_cast<uint32_t>(functions.size());
+        for (size_t i = 0;; i++) {
+            const uint32_t thunk = ReadDword(image, image_size, lookup + i * sizeof(uint32_t));
+            if (!thunk)
+                break;
+
+            if (thunk & OrdinalFlag)
+                functions.push_back({ dll, {}, static_cast<uint16_t>(thunk) });
+            else // IMAGE_IMPORT_BY_NAME: a 16-bit hint followed by the name
+                functions.push_back({ dll, ReadString(image, image_size, thunk + sizeof(uint16_t)), 0 });
+        }
+
+        const auto count = static_cast<uint32_t>(functions.size()) - first;
+        if (count)
+            slots.push_back({ descriptor.firstThunk, descriptor.firstThunk + count * static_cast<uint32_t>(sizeof(uint32_t)), first });
+    }
+
+    std::ranges::sort(slots, {}, &SlotRange::start);
+}
+
+const std::vector<std::string>& ImportTable::GetDllNames() const
+{
+    return dlls;
+}
+
+const std::vector<ImportedFunction>& ImportTable::GetFunctions() const
+{
+    return functions;
+}
+
+const ImportedFunction* ImportTable::FindBySlot(uint32_t rva) const
+{
+    // Find the last IAT starting at or before the address
+    const auto it = std::ranges::upper_bound(slots, rva, {}, &SlotRange::start);
+    if (it == slots.begin())
+        return nullptr;
+
+    const SlotRange& range = *std::prev(it);
+    if (rva >= range.end || (rva - range.start) % sizeof(uint32_t))
+        return nullptr;
+
+    return &functions[range.first + (rva - range.start) / sizeof(uint32_t)];
+}
+
+bool ImportTable::IsSlot(uint32_t rva) const
+{
+    return FindBySlot(rva) != nullptr;
+}
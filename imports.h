@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct ImportedFunction
+{
+	uint32_t dll; // index in ImportTable::GetDllNames()
+	std::string name; // empty when imported by ordinal
+	uint16_t ordinal;
+};
+
+// Import directory of an image, decoded once.
+// Every IAT slot maps to the function the loader writes into it, so an
+// indirect call through [slot] can be classified as external without
+// looking at the code behind it.
+class ImportTable
+{
+public:
+	ImportTable() = default;
+	ImportTable(const uint8_t* image, size_t image_size, uint32_t directory_rva, uint32_t directory_size);
+
+	const std::vector<std::string>& GetDllNames() const;
+	const std::vector<ImportedFunction>& GetFunctions() const;
+	const ImportedFunction* FindBySlot(uint32_t rva) const;
+	bool IsSlot(uint32_t rva) const;
+private:
+	struct SlotRange
+	{
+		uint32_t start; // RVA of the first IAT slot of a DLL
+		uint32_t end;
+		uint32_t first; // index in functions of the first slot
+	};
+
+	std::vector<std::string> dlls;
+	std::vector<ImportedFunction> functions;
+	std::vector<SlotRange> slots; // sorted by start
+};
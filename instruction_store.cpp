@@ -0,0 +1,199 @@
+#include "instruction_store.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+void InstructionStore::attach(const PatchOverlay& source)
+{
+    this->source = &source;
+}
+
+void InstructionStore::add(uint32_t address, const DecodedInstruction& decoded, uint8_t flags)
+{
+    // Adding in address order keeps the store sorted for free
+    if (!addresses.empty() && address <= addresses.back())
+        sorted = false;
+
+    addresses.push_back(address);
+    this->decoded.push_back(decoded);
+    this->flags.push_back(flags);
+    padding.push_back(0);
+}
+
+void InstructionStore::append(const InstructionStore& other)
+{
+    for (size_t i = 0; i < other.size(); i++) {
+        add(other.addresses[i], other.decoded[i], other.flags[i]);
+        padding.back() = other.padding[i];
+    }
+}
+
+void InstructionStore::replace(size_t index, const DecodedInstruction& decoded, uint8_t padding)
+{
+    // The new bytes are in the overlay already
+    this->decoded[index] = decoded;
+    this->padding[index] = padding;
+    flags[index] |= INSTRUCTION_EDITED;
+}
+
+void InstructionStore::reorder(size_t first, std::span<const uint32_t> order)
+{
+    // The instructions from first take the given order, laid out again from the address of the first one
+    std::vector<DecodedInstruction> moved;
+    std::vector<uint8_t> movedFlags;
+    std::vector<uint8_t> movedPadding;
+    moved.reserve(order.size());
+    movedFlags.reserve(order.size());
+    movedPadding.reserve(order.size());
+    for (const uint32_t i : order) {
+        moved.push_back(decoded[first + i]);
+        movedFlags.push_back(flags[first + i] | INSTRUCTION_EDITED | INSTRUCTION_MOVED);
+        movedPadding.push_back(padding[first + i]);
+    }
+    uint32_t address = addresses[first];
+    for (size_t i = 0; i < order.size(); i++) {
+        addresses[first + i] = address;
+        decoded[first + i] = moved[i];
+        flags[first + i] = movedFlags[i];
+        padding[first + i] = movedPadding[i];
+        address += moved[i].length + movedPadding[i];
+    }
+}
+
+void InstructionStore::erase(std::span<const size_t> indices)
+{
+    // Indices are sorted; everything else moves down in one pass
+    size_t kept = indices.empty() ? size() : indices.front();
+    for (size_t i = kept, next = 0; i < size(); i++) {
+        if (next < indices.size() && indices[next] == i) {
+            next++;
+            continue;
+        }
+        addresses[kept] = addresses[i];
+        decoded[kept] = decoded[i];
+        flags[kept] = flags[i];
+        padding[kept] = padding[i];
+        kept++;
+    }
+    addresses.resize(kept);
+    decoded.resize(kept);
+    flags.resize(kept);
+    padding.resize(kept);
+}
+
+void InstructionStore::seal()
+{
+    if (sorted)
+        return;
+
+    // Sort a permutation, keeping the first instruction decoded at each address
+    std::vector<uint32_t> order(addresses.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::stable_sort(order, {}, [this](uint32_t i) { return addresses[i]; });
+    const auto [first, last] = std::ranges::unique(order, {}, [this](uint32_t i) { return addresses[i]; });
+    order.erase(first, last);
+
+    const auto permute = [&order](auto& array) {
+        std::remove_reference_t<decltype(array)> permuted;
+        permuted.reserve(order.size());
+        for (const uint32_t i : order)
+            permuted.push_back(array[i]);
+        array = std::move(permuted);
+    };
+    permute(addresses);
+    permute(decoded);
+    permute(flags);
+    permute(padding);
+    sorted = true;
+}
+
+void InstructionStore::clear()
+{
+    addresses.clear();
+    decoded.clear();
+    flags.clear();
+    padding.clear();
+    sorted = true;
+}
+
+void InstructionStore::reserve(size_t count)
+{
+    addresses.reserve(count);
+    decoded.reserve(count);
+    flags.reserve(count);
+    padding.reserve(count);
+}
+
+InstructionStore::Iterator InstructionStore::lowerBound(uint32_t address) const
+{
+    if (!sorted)
+        throw std::logic_error("Instruction store must be sealed before lookups.");
+    return { this, static_cast<size_t>(std::ranges::lower_bound(addresses, address) - addresses.begin()) };
+}
+
+InstructionStore::Iterator InstructionStore::find(uint32_t address) const
+{
+    const Iterator it = lowerBound(address);
+    return it != end() && addresses[it.getIndex()] == address ? it : end();
+}
+
+bool InstructionStore::contains(uint32_t address) const
+{
+    return find(address) != end();
+}
+
+InstructionStore::Instruction InstructionStore::operator [] (size_t index) const
+{
+    return { addresses[index], getBytes(index), decoded[index], flags[index], getEnd(index) };
+}
+
+std::span<const uint8_t> InstructionStore::getBytes(size_t index) const
+{
+    return source->View(addresses[index], decoded[index].length);
+}
+
+uint32_t InstructionStore::getAddress(size_t index) const
+{
+    return addresses[index];
+}
+
+uint32_t InstructionStore::getEnd(size_t index) const
+{
+    return addresses[index] + decoded[index].length + padding[index];
+}
+
+const DecodedInstruction& InstructionStore::getDecoded(size_t index) const
+{
+    return decoded[index];
+}
+
+uint8_t InstructionStore::getFlags(size_t index) const
+{
+    return flags[index];
+}
+
+void InstructionStore::setFlags(size_t index, uint8_t flags)
+{
+    this->flags[index] = flags;
+}
+
+size_t InstructionStore::size() const
+{
+    return addresses.size();
+}
+
+bool InstructionStore::empty() const
+{
+    return addresses.empty();
+}
+
+InstructionStore::Iterator InstructionStore::begin() const
+{
+    return { this, 0 };
+}
+
+InstructionStore::Iterator InstructionStore::end() const
+{
+    return { this, addresses.size() };
+}
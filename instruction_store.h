@@ -0,0 +1,99 @@
+#pragma once
+
+#ifndef INSTRUCTION_STORE_H
+#define INSTRUCTION_STORE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <span>
+#include <vector>
+
+#include "decoded_instruction.h"
+#include "patch_overlay.h"
+
+enum INSTRUCTION_FLAGS : uint8_t
+{
+	INSTRUCTION_EDITED = 1, // bytes differ from the virtual image
+	INSTRUCTION_SWEPT = 2, // found by the linear sweep, not reached from the entry point
+	INSTRUCTION_ADDED = 4, // added by an edit, not decoded from the virtual image
+	INSTRUCTION_MOVED = 8 // laid out again by a reorder; only the run as a whole keeps the original boundaries
+};
+
+// Decoded instructions kept as parallel arrays sorted by address, with the
+// DecodedInstruction computed when each one was read, so later passes never
+// decode it again. The store keeps no bytes: they are read from the virtual
+// image through the patch overlay it is attached to.
+// add() appends in any order; seal() must be called before looking anything up
+// if the instructions weren't added in increasing address order.
+class InstructionStore
+{
+public:
+	struct Instruction
+	{
+		uint32_t address;
+		std::span<const uint8_t> bytes;
+		const DecodedInstruction& decoded;
+		uint8_t flags;
+		uint32_t end; // past the NOPs an edit padded it with, where the next instruction can start
+	};
+
+	class Iterator
+	{
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = Instruction;
+		using difference_type = std::ptrdiff_t;
+
+		Iterator() = default;
+		Iterator(const InstructionStore* store, size_t index) : store(store), index(index) {}
+
+		Instruction operator * () const { return (*store)[index]; }
+		Iterator& operator ++ () { index++; return *this; }
+		Iterator operator ++ (int) { Iterator it = *this; index++; return it; }
+		Iterator& operator -- () { index--; return *this; }
+		Iterator& operator += (difference_type n) { index += n; return *this; }
+		Iterator operator + (difference_type n) const { return { store, index + n }; }
+		difference_type operator - (const Iterator& other) const { return static_cast<difference_type>(index) - static_cast<difference_type>(other.index); }
+		bool operator == (const Iterator& other) const { return index == other.index; }
+		size_t getIndex() const { return index; }
+	private:
+		const InstructionStore* store{};
+		size_t index{};
+	};
+
+	void attach(const PatchOverlay& source);
+	void add(uint32_t address, const DecodedInstruction& decoded, uint8_t flags = 0);
+	void append(const InstructionStore& other);
+	void replace(size_t index, const DecodedInstruction& decoded, uint8_t padding = 0); // padding: NOPs after the new bytes, up to the old end
+	void reorder(size_t first, std::span<const uint32_t> order);
+	void erase(std::span<const size_t> indices);
+	void seal();
+	void clear();
+	void reserve(size_t count);
+
+	Iterator find(uint32_t address) const;
+	Iterator lowerBound(uint32_t address) const;
+	bool contains(uint32_t address) const;
+
+	Instruction operator [] (size_t index) const;
+	std::span<const uint8_t> getBytes(size_t index) const;
+	uint32_t getAddress(size_t index) const;
+	uint32_t getEnd(size_t index) const;
+	const DecodedInstruction& getDecoded(size_t index) const;
+	uint8_t getFlags(size_t index) const;
+	void setFlags(size_t index, uint8_t flags);
+	size_t size() const;
+	bool empty() const;
+	Iterator begin() const;
+	Iterator end() const;
+private:
+	std::vector<uint32_t> addresses;
+	std::vector<DecodedInstruction> decoded;
+	std::vector<uint8_t> flags;
+	std::vector<uint8_t> padding; // NOPs filling out the rest of what a shorter edit replaced
+	const PatchOverlay* source{};
+	bool sorted{ true };
+};
+
+#endif
@@ -0,0 +1,179 @@
+#include "liveness.h"
+
+#include <algorithm>
+#include <deque>
+#include <utility>
+
+#include "disassembler.h"
+
+RegisterMask getReadMask(const DecodedInstruction& decoded)
+{
+    return static_cast<RegisterMask>(decoded.regsRead | decoded.flagsRead << 8);
+}
+
+RegisterMask getWriteMask(const DecodedInstruction& decoded)
+{
+    return static_cast<RegisterMask>(decoded.regsWritten | decoded.flagsWritten << 8);
+}
+
+void Liveness::Build(const BlockGraph& blocks, const InstructionStore& code, std::span<const uint32_t> exits)
+{
+    Clear();
+    Update(blocks, code, {}, exits);
+}
+
+void Liveness::Update(const BlockGraph& blocks, const InstructionStore& code, std::span<const uint32_t> changed, std::span<const uint32_t> exits)
+{
+    // New blocks are changed too; a full build sees every block, successors before predecessors
+    const size_t count = blocks.Size(), known = in.size();
+    for (std::vector<RegisterMask>* masks : { &gen, &kill, &escaping, &in, &out })
+        masks->resize(count);
+    firsts.resize(count);
+    counts.resize(count);
+    std::vector<uint32_t> seeds;
+    if (!known) {
+        seeds = blocks.ReversePostOrder();
+        std::ranges::reverse(seeds);
+    }
+    else {
+        seeds.assign(changed.begin(), changed.end());
+        for (uint32_t id = static_cast<uint32_t>(known); id < count; id++)
+            seeds.push_back(id);
+    }
+    for (const uint32_t id : seeds)
+        Summarize(blocks, code, id, std::ranges::binary_search(exits, id));
+
+    // Everything that reaches the changed blocks is solved again from nothing: stale masks
+    // going around a loop could otherwise keep each other alive, or never settle
+    if (known) {
+        seeds = blocks.Closure(seeds, false);
+        for (const uint32_t id : seeds)
+            in[id] = out[id] = 0;
+    }
+    Propagate(blocks, code, seeds);
+
+    // Blocks that moved to the end of the arena left their old entries behind; drop them once they're most of it
+    if (unused > addresses.size() / 2) {
+        std::vector<uint32_t> compacted;
+        std::vector<RegisterMask> compacted_after;
+        compacted.reserve(addresses.size() - unused);
+        compacted_after.reserve(addresses.size() - unused);
+        for (uint32_t id = 0; id < count; id++) {
+            const uint32_t first = firsts[id];
+            firsts[id] = static_cast<uint32_t>(compacted.size());
+            compacted.insert(compacted.end(), addresses.begin() + first, addresses.begin() + first + counts[id]);
+            compacted_after.insert(compacted_after.end(), after.begin() + first, after.begin() + first + counts[id]);
+        }
+        addresses = std::move(compacted);
+        after = std::move(compacted_after);
+        unused = 0;
+    }
+}
+
+void Liveness::Summarize(const BlockGraph& blocks, const InstructionStore& code, uint32_t id, bool exit)
+{
+    // The block keeps its place in the arena unless its instruction count changed
+    const size_t first = code.lowerBound(blocks[id].start_address).getIndex();
+    const size_t last = code.lowerBound(blocks[id].end_address).getIndex();
+    const uint32_t count = static_cast<uint32_t>(last - first);
+    if (count != counts[id]) {
+        unused += counts[id];
+        firsts[id] = static_cast<uint32_t>(addresses.size());
+        counts[id] = count;
+        addresses.resize(addresses.size() + count);
+        after.resize(after.size() + count);
+    }
+
+    gen[id] = kill[id] = 0;
+    for (size_t i = last; i-- > first;) {
+        const DecodedInstruction& decoded = code.getDecoded(i);
+        gen[id] = static_cast<RegisterMask>((gen[id] & ~getWriteMask(decoded)) | getReadMask(decoded));
+        kill[id] |= getWriteMask(decoded);
+        addresses[firsts[id] + (i - first)] = code.getAddress(i);
+    }
+    escaping[id] = Escaping(code.getDecoded(last - 1), exit);
+}
+
+void Liveness::Propagate(const BlockGraph& blocks, const InstructionStore& code, std::span<const uint32_t> seeds)
+{
+    // Seeds are walked at least once: their instructions changed even if what leaves them didn't
+    std::vector<bool> queued(blocks.Size()), stale(blocks.Size());
+    std::deque<uint32_t> worklist;
+    for (const uint32_t id : seeds) {
+        stale[id] = true;
+        if (!queued[id]) {
+            queued[id] = true;
+            worklist.push_back(id);
+        }
+    }
+
+    while (!worklist.empty()) {
+        const uint32_t id = worklist.front();
+        worklist.pop_front();
+        queued[id] = false;
+
+        RegisterMask live = escaping[id];
+        for (const uint32_t successor : blocks.Successors(id))
+            live |= in[successor];
+
+        // Walk the block back to keep the mask after each instruction, when what leaves it changed
+        if (live != out[id] || stale[id]) {
+            out[id] = live;
+            stale[id] = false;
+            const size_t first = code.lowerBound(blocks[id].start_address).getIndex();
+            for (size_t i = first + counts[id]; i-- > first;) {
+                after[firsts[id] + (i - first)] = live;
+                const DecodedInstruction& decoded = code.getDecoded(i);
+                live = static_cast<RegisterMask>((live & ~getWriteMask(decoded)) | getReadMask(decoded));
+            }
+        }
+        const RegisterMask live_in = static_cast<RegisterMask>(gen[id] | (out[id] & ~kill[id]));
+        if (live_in == in[id])
+            continue;
+        in[id] = live_in;
+        for (const uint32_t predecessor : blocks.Predecessors(id)) {
+            if (!queued[predecessor]) {
+                queued[predecessor] = true;
+                worklist.push_back(predecessor);
+            }
+        }
+    }
+}
+
+void Liveness::Clear()
+{
+    for (std::vector<RegisterMask>* masks : { &gen, &kill, &escaping, &in, &out, &after })
+        masks->clear();
+    firsts.clear();
+    counts.clear();
+    addresses.clear();
+    unused = 0;
+}
+
+RegisterMask Liveness::LiveIn(uint32_t id) const
+{
+    return id < in.size() ? in[id] : MaskAll;
+}
+
+RegisterMask Liveness::LiveOut(uint32_t id) const
+{
+    return id < out.size() ? out[id] : MaskAll;
+}
+
+RegisterMask Liveness::LiveAfter(uint32_t id, uint32_t addr) const
+{
+    if (id >= counts.size())
+        return MaskAll;
+    const auto first = addresses.begin() + firsts[id], last = first + counts[id];
+    const auto it = std::lower_bound(first, last, addr);
+    return it != last && *it == addr ? after[it - addresses.begin()] : MaskAll;
+}
+
+RegisterMask Liveness::Escaping(const DecodedInstruction& last, bool exit)
+{
+    if (last.type == INSTRUCTION_TYPE::RET)
+        return 0;
+    if (last.type == INSTRUCTION_TYPE::INT_CALL && last.opcode == 0xCC)
+        return MaskAll;
+    return exit ? MaskAll : 0;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#ifndef LIVENESS_H
+#define LIVENESS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "block_graph.h"
+#include "decoded_instruction.h"
+
+class InstructionStore;
+
+// Registers and arithmetic flags in one mask: a bit per REGISTER, then the FLAG bits
+using RegisterMask = uint16_t;
+constexpr RegisterMask MaskRegisters = 0x00FF;
+constexpr RegisterMask MaskFlags = FLAGS_ALL << 8;
+constexpr RegisterMask MaskAll = MaskRegisters | MaskFlags;
+
+RegisterMask getReadMask(const DecodedInstruction& decoded);
+RegisterMask getWriteMask(const DecodedInstruction& decoded); // includes writes that also read
+
+// Backward liveness of the registers and flags over a block graph. Each block is
+// reduced to what it reads before writing (gen) and what it writes (kill), and
+// those masks are iterated to a fixpoint from a worklist. The mask live after
+// every instruction of a block is kept with its address, so asking whether the
+// flags are dead after an instruction is a lookup and a single AND, and edits to
+// the store can't make it answer for another instruction.
+// Update() only solves the blocks an edit changed and the blocks that reach
+// them again; nothing else can see the difference.
+// Wherever control leaves the graph, everything is live; the caller names those
+// exit blocks, since only it knows where each block really goes. After a return
+// the flags aren't live, and the return itself reads the registers.
+class Liveness
+{
+public:
+	void Build(const BlockGraph& blocks, const InstructionStore& code, std::span<const uint32_t> exits);
+	void Update(const BlockGraph& blocks, const InstructionStore& code, std::span<const uint32_t> changed, std::span<const uint32_t> exits); // exits: the changed blocks control can leave the graph from
+	void Clear();
+	RegisterMask LiveIn(uint32_t id) const;
+	RegisterMask LiveOut(uint32_t id) const;
+	RegisterMask LiveAfter(uint32_t id, uint32_t addr) const; // all live for instructions the pass didn't see
+private:
+	void Summarize(const BlockGraph& blocks, const InstructionStore& code, uint32_t id, bool exit);
+	void Propagate(const BlockGraph& blocks, const InstructionStore& code, std::span<const uint32_t> seeds);
+	static RegisterMask Escaping(const DecodedInstruction& last, bool exit);
+
+	std::vector<RegisterMask> gen; // by block id
+	std::vector<RegisterMask> kill;
+	std::vector<RegisterMask> escaping;
+	std::vector<RegisterMask> in;
+	std::vector<RegisterMask> out;
+	std::vector<uint32_t> firsts; // by block id, into addresses and after
+	std::vector<uint32_t> counts;
+	std::vector<uint32_t> addresses; // arena of the instructions of every block, in order
+	std::vector<RegisterMask> after;
+	size_t unused{}; // arena entries of blocks that moved to the end
+};
+
+#endif
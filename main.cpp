@@ -1,7 +1,10 @@
-#include <chrono>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
 
 #include "PEParser.h"
 #include "disassembler.h"
@@ -13,42 +16,47 @@ int main(int argc, char* argv[])
 		return EXIT_FAILURE;
 	}
 
-	auto read_file = []() {
-		std::cout << "Reading file.";
-		for (int i = 0; i < 4; i++) {
-			std::cout.flush();
-			std::this_thread::sleep_for(std::chrono::seconds(75));
-			std::cout << ".";
-		}
-	};
-
-	read_file();
+	// Detection
+	std::cout << "Detecting file type...\n";
 
-	std::ifstream input_file(argv[1], std::ios::binary);
-	if (!input_file) {
-		std::cerr << "Error: Could not open file\n";
-		return EXIT_FAILURE;
+	// Map the input copy-on-write; fall back to reading it into a buffer if it can't be mapped.
+	// The parser keeps pointing at the buffer and the size, so both outlive it
+	std::vector<uint8_t> buffer;
+	size_t data_size{};
+	std::unique_ptr<PEParser> parser;
+	try {
+		parser = std::make_unique<PEParser>(arg_path);
 	}
+	catch (const std::system_error&) {
+		std::ifstream input_file(arg_path, std::ios::binary | std::ios::ate);
+		if (!input_file) {
+			std::cerr << "Error: Could not open file\n";
+			return EXIT_FAILURE;
+		}
 
-	size_t data_size = input_file.tellg();
-	auto* data = new uint8_t[data_size];
-
-	input_file.seekg(0, std::ios_base::beg);
-	input_file.read(reinterpret_cast<char*>(data), data_size);
-	input_file.close();
+		data_size = input_file.tellg();
+		buffer.resize(data_size);
 
-	std::cout << "Read " << data_size << " bytes\n";
-
-	// Detection
-	std::cout << "Detecting file type...\n";
+		input_file.seekg(0, std::ios_base::beg);
+		input_file.read(reinterpret_cast<char*>(buffer.data()), data_size);
+		input_file.close();
 
-	std::cout << new PEParser{ data, data_size };
-	if( const PEParser* parser = nullptr; !parser)
+		try {
+			parser = std::make_unique<PEParser>(buffer.data(), data_size);
+		}
+		catch (const std::exception&) {
+			exit("ERROR:  Couldn't detect file type.\n");
+		}
+	}
+	catch (const std::exception&) {
+		// The file was mapped; it just isn't a PE this can parse
 		exit("ERROR:  Couldn't detect file type.\n");
+	}
+	data_size = parser->GetData().second;
 
-	std::cout << "PE parser created\n";
+	std::cout << "Read " << data_size << " bytes\n";
 
-	std::cerr << "Could not detect file type\n";
+	std::cout << "PE parser created\n";
 
 	std::cout << "Disassembling...\n";
 
@@ -69,17 +77,14 @@ int main(int argc, char* argv[])
 	// TODO: Rebuild pseudo:
 
 	/**
-	 disasm->updateVirtualImageFromInstructions();
-	parser->updateDataFromVirtualImage();
-	std::pair<uint8_t*, size_t> new_data = parser->getData();
-	fstream output;
-	output.open(arg_out.c_str(), ios_base::out | ios_base::binary | ios_bas::truncate);
-	if(!output.is_open())
-		exit("Failed to open output file.");
-    
-	output.write(char*)new_data.first, new_data.second);
-	output.close();
-	std::cout << "Rebuilt (" << dataSize << " bytes\n";
+	 disasm->UpdateVirtualImageFromInstructions();
+	try {
+		parser->Write(arg_out);
+	}
+	catch (const std::runtime_error& e) {
+		exit(std::string("Failed to write output file: ") + e.what() + "\n");
+	}
+	std::cout << "Rebuilt (" << parser->GetData().second << " bytes)\n";
 	 **/
 
 	system("pause");
@@ -0,0 +1,121 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+#include <system_error>
+
+namespace
+{
+    // Win32 failures keep their error code, so callers can tell them from bad contents
+    std::system_error Win32Error(DWORD error, const char* what)
+    {
+        return std::system_error(static_cast<int>(error), std::system_category(), what);
+    }
+}
+
+MappedFile::MappedFile(const std::string& path) :
+    path(path), file{ INVALID_HANDLE_VALUE }, mapping{}, view{}, size{}
+{
+    // Open the file read-only; the mapping below never writes back to it
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw Win32Error(GetLastError(), "Could not open file.");
+
+    // Get the size of the file
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+    {
+        const DWORD error = file_size.QuadPart == 0 ? ERROR_HANDLE_EOF : GetLastError();
+        CloseHandle(file);
+        throw Win32Error(error, "Could not get the size of the file or file is empty.");
+    }
+    size = static_cast<size_t>(file_size.QuadPart);
+
+    // PAGE_WRITECOPY + FILE_MAP_COPY give us a private view: pages are shared with
+    // the page cache until a transform writes to them
+    mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (!mapping)
+    {
+        const DWORD error = GetLastError();
+        CloseHandle(file);
+        throw Win32Error(error, "Could not create the file mapping.");
+    }
+
+    view = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+    if (!view)
+    {
+        const DWORD error = GetLastError();
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw Win32Error(error, "Could not map the file.");
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    UnmapViewOfFile(view);
+    CloseHandle(mapping);
+    CloseHandle(file);
+}
+
+uint8_t* MappedFile::GetData() const
+{
+    return view;
+}
+
+size_t& MappedFile::GetSize()
+{
+    return size;
+}
+
+const std::string& MappedFile::GetPath() const
+{
+    return path;
+}
+
+OutputFile::OutputFile(const std::string& path, size_t size, bool keep_contents) :
+    file{ INVALID_HANDLE_VALUE }, mapping{}, view{}
+{
+    // Either reuse what was already copied to the file or start from an empty one
+    file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+        keep_contents ? OPEN_EXISTING : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Could not open the output file.");
+
+    // Truncate or extend the file to its final size; new bytes read as zero
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<long long>(size);
+    if (!SetFilePointerEx(file, end, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+    {
+        CloseHandle(file);
+        throw std::runtime_error("Could not resize the output file.");
+    }
+
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+    if (!mapping)
+    {
+        CloseHandle(file);
+        throw std::runtime_error("Could not create the output file mapping.");
+    }
+
+    view = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0));
+    if (!view)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::runtime_error("Could not map the output file.");
+    }
+}
+
+OutputFile::~OutputFile()
+{
+    FlushViewOfFile(view, 0);
+    UnmapViewOfFile(view);
+    CloseHandle(mapping);
+    CloseHandle(file);
+}
+
+uint8_t* OutputFile::GetData() const
+{
+    return view;
+}
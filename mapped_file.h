@@ -0,0 +1,49 @@
+#pragma once
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <Windows.h>
+#include <cstdint>
+#include <string>
+
+// Private, copy-on-write view of a file on disk.
+// Reads are served straight from the page cache; the first write to a page
+// gives the process its own copy of that page and never reaches the file.
+class MappedFile
+{
+public:
+	explicit MappedFile(const std::string& path);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	void operator = (const MappedFile&) = delete;
+
+	uint8_t* GetData() const;
+	size_t& GetSize();
+	const std::string& GetPath() const;
+private:
+	std::string path;
+	HANDLE file;
+	HANDLE mapping;
+	uint8_t* view;
+	size_t size;
+};
+
+// Writable view of an output file, truncated or extended to a given size.
+// The final layout is built straight in the page cache and flushed on destruction.
+class OutputFile
+{
+public:
+	OutputFile(const std::string& path, size_t size, bool keep_contents);
+	~OutputFile();
+	OutputFile(const OutputFile&) = delete;
+	void operator = (const OutputFile&) = delete;
+
+	uint8_t* GetData() const;
+private:
+	HANDLE file;
+	HANDLE mapping;
+	uint8_t* view;
+};
+
+#endif
@@ -0,0 +1,202 @@
+#pragma once
+
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include <array>
+#include <cstdint>
+
+#include "disassembler.h"
+
+// Size of the immediate following the opcode and ModRM/SIB/displacement bytes
+enum class IMM_TYPE : uint8_t
+{
+	NONE,
+	IB, // 1 byte
+	IW, // 2 bytes
+	IZ, // 2 bytes with an operand size prefix, 4 otherwise
+	IWB, // ENTER: 3 bytes
+	AP, // far pointer: 4 bytes with an operand size prefix, 6 otherwise
+	MOFFS, // 2 bytes with an address size prefix, 4 otherwise
+	GROUP3 // F6/F7: IB/IZ for TEST (/0 and /1), none for the others
+};
+
+// Everything the decoder needs to know about an opcode, packed in 4 bytes
+struct OpcodeInfo
+{
+	uint8_t modrm : 1; // followed by a ModRM byte
+	uint8_t prefix : 1;
+	uint8_t invalid : 1; // undefined in 32-bit mode
+	uint8_t group : 1; // the instruction type depends on ModRM.reg
+	IMM_TYPE imm;
+	INSTRUCTION_TYPE type;
+	OP_TYPE operands;
+};
+
+constexpr std::array<OpcodeInfo, 256> makeOneByteOpcodes()
+{
+	std::array<OpcodeInfo, 256> t{};
+	const auto set = [&t](int first, int last, bool modrm, IMM_TYPE imm, INSTRUCTION_TYPE type, OP_TYPE operands) {
+		for (int op = first; op <= last; op++)
+			t[op] = { modrm, 0, 0, 0, imm, type, operands };
+	};
+	using enum IMM_TYPE;
+	using I = INSTRUCTION_TYPE;
+	using O = OP_TYPE;
+
+	// 00-3F: ADD/OR/ADC/SBB/AND/SUB/XOR/CMP rows, with segment pushes/pops and BCD adjustments in columns 6, 7, E, F
+	for (int row = 0x00; row < 0x40; row += 8) {
+		set(row + 0, row + 0, true, NONE, I::OTHER, O::EBGB);
+		set(row + 1, row + 1, true, NONE, I::OTHER, O::EVGV);
+		set(row + 2, row + 2, true, NONE, I::OTHER, O::GBEB);
+		set(row + 3, row + 3, true, NONE, I::OTHER, O::GVEV);
+		set(row + 4, row + 4, false, IB, I::OTHER, O::IB);
+		set(row + 5, row + 5, false, IZ, I::OTHER, O::IV);
+		set(row + 6, row + 7, false, NONE, row < 0x20 ? I::STACK : I::OTHER, O::NONE);
+	}
+	set(0x0F, 0x0F, false, NONE, I::OTHER, O::OTHER); // two-byte escape, handled by the decoder
+
+	set(0x40, 0x4F, false, NONE, I::OTHER, O::NONE); // INC/DEC r32
+	set(0x50, 0x5F, false, NONE, I::STACK, O::NONE); // PUSH/POP r32
+	set(0x60, 0x61, false, NONE, I::STACK, O::NONE); // PUSHA/POPA
+	set(0x62, 0x62, true, NONE, I::OTHER, O::GVM); // BOUND
+	set(0x63, 0x63, true, NONE, I::OTHER, O::EVGV); // ARPL
+	set(0x68, 0x68, false, IZ, I::STACK, O::IV);
+	set(0x69, 0x69, true, IZ, I::OTHER, O::GVEV); // IMUL Gv, Ev, Iz
+	set(0x6A, 0x6A, false, IB, I::STACK, O::IB);
+	set(0x6B, 0x6B, true, IB, I::OTHER, O::GVEV); // IMUL Gv, Ev, Ib
+	set(0x6C, 0x6F, false, NONE, I::OTHER, O::NONE); // INS/OUTS
+	set(0x70, 0x7F, false, IB, I::C_JMP, O::IB); // Jcc rel8
+
+	set(0x80, 0x80, true, IB, I::OTHER, O::IB); // group 1
+	set(0x81, 0x81, true, IZ, I::OTHER, O::IV);
+	set(0x82, 0x83, true, IB, I::OTHER, O::IB);
+	set(0x84, 0x84, true, NONE, I::OTHER, O::EBGB); // TEST
+	set(0x85, 0x85, true, NONE, I::OTHER, O::EVGV);
+	set(0x86, 0x86, true, NONE, I::OTHER, O::EBGB); // XCHG
+	set(0x87, 0x87, true, NONE, I::OTHER, O::EVGV);
+	set(0x88, 0x88, true, NONE, I::OTHER, O::EBGB); // MOV
+	set(0x89, 0x89, true, NONE, I::OTHER, O::EVGV);
+	set(0x8A, 0x8A, true, NONE, I::OTHER, O::GBEB);
+	set(0x8B, 0x8B, true, NONE, I::OTHER, O::GVEV);
+	set(0x8C, 0x8C, true, NONE, I::OTHER, O::OTHER); // MOV Ev, Sw
+	set(0x8D, 0x8D, true, NONE, I::OTHER, O::GVM); // LEA
+	set(0x8E, 0x8E, true, NONE, I::OTHER, O::OTHER); // MOV Sw, Ew
+	set(0x8F, 0x8F, true, NONE, I::STACK, O::OTHER); // POP Ev
+
+	set(0x90, 0x90, false, NONE, I::NOP, O::NONE);
+	set(0x91, 0x99, false, NONE, I::OTHER, O::NONE); // XCHG eAX, CWDE, CDQ
+	set(0x9A, 0x9A, false, AP, I::CALL, O::OTHER); // CALL far
+	set(0x9B, 0x9B, false, NONE, I::x87_FPU, O::NONE); // FWAIT
+	set(0x9C, 0x9D, false, NONE, I::STACK, O::NONE); // PUSHF/POPF
+	set(0x9E, 0x9F, false, NONE, I::OTHER, O::NONE); // SAHF/LAHF
+
+	set(0xA0, 0xA3, false, MOFFS, I::OTHER, O::OTHER); // MOV eAX, moffs
+	set(0xA4, 0xA7, false, NONE, I::OTHER, O::NONE); // MOVS/CMPS
+	set(0xA8, 0xA8, false, IB, I::OTHER, O::IB); // TEST AL, Ib
+	set(0xA9, 0xA9, false, IZ, I::OTHER, O::IV);
+	set(0xAA, 0xAF, false, NONE, I::OTHER, O::NONE); // STOS/LODS/SCAS
+	set(0xB0, 0xB7, false, IB, I::OTHER, O::IB); // MOV r8, Ib
+	set(0xB8, 0xBF, false, IZ, I::OTHER, O::IV); // MOV r32, Iv
+
+	set(0xC0, 0xC1, true, IB, I::OTHER, O::IB); // group 2
+	set(0xC2, 0xC2, false, IW, I::RET, O::OTHER);
+	set(0xC3, 0xC3, false, NONE, I::RET, O::NONE);
+	set(0xC4, 0xC5, true, NONE, I::OTHER, O::GVM); // LES/LDS
+	set(0xC6, 0xC6, true, IB, I::OTHER, O::IB); // MOV Eb, Ib
+	set(0xC7, 0xC7, true, IZ, I::OTHER, O::IV); // MOV Ev, Iz
+	set(0xC8, 0xC8, false, IWB, I::STACK, O::OTHER); // ENTER
+	set(0xC9, 0xC9, false, NONE, I::STACK, O::NONE); // LEAVE
+	set(0xCA, 0xCA, false, IW, I::RET, O::OTHER);
+	set(0xCB, 0xCB, false, NONE, I::RET, O::NONE);
+	set(0xCC, 0xCC, false, NONE, I::INT_CALL, O::NONE);
+	set(0xCD, 0xCD, false, IB, I::INT_CALL, O::IB);
+	set(0xCE, 0xCE, false, NONE, I::INT_CALL, O::NONE);
+	set(0xCF, 0xCF, false, NONE, I::RET, O::NONE); // IRET
+
+	set(0xD0, 0xD3, true, NONE, I::OTHER, O::OTHER); // group 2
+	set(0xD4, 0xD5, false, IB, I::OTHER, O::IB); // AAM/AAD
+	set(0xD6, 0xD7, false, NONE, I::OTHER, O::NONE); // SALC/XLAT
+	set(0xD8, 0xDF, true, NONE, I::x87_FPU, O::OTHER);
+
+	set(0xE0, 0xE3, false, IB, I::C_JMP, O::IB); // LOOPcc/JECXZ
+	set(0xE4, 0xE7, false, IB, I::OTHER, O::IB); // IN/OUT Ib
+	set(0xE8, 0xE8, false, IZ, I::CALL, O::IV);
+	set(0xE9, 0xE9, false, IZ, I::UNC_JMP, O::IV);
+	set(0xEA, 0xEA, false, AP, I::UNC_JMP, O::OTHER); // JMP far
+	set(0xEB, 0xEB, false, IB, I::UNC_JMP, O::IB);
+	set(0xEC, 0xEF, false, NONE, I::OTHER, O::NONE); // IN/OUT DX
+
+	set(0xF1, 0xF1, false, NONE, I::INT_CALL, O::NONE); // INT1
+	set(0xF4, 0xF5, false, NONE, I::OTHER, O::NONE); // HLT/CMC
+	set(0xF6, 0xF7, true, GROUP3, I::OTHER, O::OTHER);
+	set(0xF8, 0xFD, false, NONE, I::OTHER, O::NONE); // CLC..STD
+	set(0xFE, 0xFE, true, NONE, I::OTHER, O::OTHER); // group 4
+	set(0xFF, 0xFF, true, NONE, I::OTHER, O::OTHER); // group 5: INC/DEC/CALL/JMP/PUSH Ev
+	t[0xFF].group = 1;
+
+	// Prefixes: segment overrides, operand and address size, LOCK, REPNE/REP
+	for (const int op : { 0x26, 0x2E, 0x36, 0x3E, 0x64, 0x65, 0x66, 0x67, 0xF0, 0xF2, 0xF3 })
+		t[op] = { 0, 1, 0, 0, NONE, I::OTHER, O::OTHER };
+
+	return t;
+}
+
+constexpr std::array<OpcodeInfo, 256> makeTwoByteOpcodes()
+{
+	std::array<OpcodeInfo, 256> t{};
+	const auto set = [&t](int first, int last, bool modrm, IMM_TYPE imm, INSTRUCTION_TYPE type, OP_TYPE operands) {
+		for (int op = first; op <= last; op++)
+			t[op] = { modrm, 0, 0, 0, imm, type, operands };
+	};
+	using enum IMM_TYPE;
+	using I = INSTRUCTION_TYPE;
+	using O = OP_TYPE;
+
+	// Most of the map is SSE/MMX with a ModRM byte and no immediate
+	set(0x00, 0xFF, true, NONE, I::OTHER, O::OTHER);
+
+	set(0x05, 0x09, false, NONE, I::OTHER, O::NONE); // SYSCALL, CLTS, SYSRET, INVD, WBINVD
+	set(0x0B, 0x0B, false, NONE, I::OTHER, O::NONE); // UD2
+	set(0x0E, 0x0E, false, NONE, I::OTHER, O::NONE); // FEMMS
+	set(0x0F, 0x0F, true, IB, I::OTHER, O::OTHER); // 3DNow!, the suffix byte acts as an immediate
+	set(0x18, 0x1F, true, NONE, I::NOP, O::OTHER); // hint NOPs and prefetches
+	set(0x30, 0x37, false, NONE, I::OTHER, O::NONE); // WRMSR, RDTSC, RDMSR, RDPMC, SYSENTER, SYSEXIT, GETSEC
+	set(0x3A, 0x3A, true, IB, I::OTHER, O::OTHER); // three-byte escape, 0F 3A xx /r ib
+	set(0x40, 0x4F, true, NONE, I::OTHER, O::GVEV); // CMOVcc
+	set(0x70, 0x73, true, IB, I::OTHER, O::OTHER); // PSHUFW, shift groups
+	set(0x77, 0x77, false, NONE, I::OTHER, O::NONE); // EMMS
+	set(0x80, 0x8F, false, IZ, I::C_JMP, O::IV); // Jcc rel32
+	set(0xA0, 0xA1, false, NONE, I::STACK, O::NONE); // PUSH/POP FS
+	set(0xA2, 0xA2, false, NONE, I::OTHER, O::NONE); // CPUID
+	set(0xA3, 0xA3, true, NONE, I::OTHER, O::EVGV); // BT
+	set(0xA4, 0xA4, true, IB, I::OTHER, O::EVGV); // SHLD Ib
+	set(0xA5, 0xA5, true, NONE, I::OTHER, O::EVGV);
+	set(0xA8, 0xA9, false, NONE, I::STACK, O::NONE); // PUSH/POP GS
+	set(0xAA, 0xAA, false, NONE, I::OTHER, O::NONE); // RSM
+	set(0xAB, 0xAB, true, NONE, I::OTHER, O::EVGV); // BTS
+	set(0xAC, 0xAC, true, IB, I::OTHER, O::EVGV); // SHRD Ib
+	set(0xAD, 0xAD, true, NONE, I::OTHER, O::EVGV);
+	set(0xAF, 0xAF, true, NONE, I::OTHER, O::GVEV); // IMUL Gv, Ev
+	set(0xB3, 0xB3, true, NONE, I::OTHER, O::EVGV); // BTR
+	set(0xBA, 0xBA, true, IB, I::OTHER, O::IB); // group 8
+	set(0xBB, 0xBB, true, NONE, I::OTHER, O::EVGV); // BTC
+	set(0xC2, 0xC2, true, IB, I::OTHER, O::OTHER); // CMPPS
+	set(0xC4, 0xC6, true, IB, I::OTHER, O::OTHER); // PINSRW, PEXTRW, SHUFPS
+	set(0xC8, 0xCF, false, NONE, I::OTHER, O::NONE); // BSWAP
+
+	// Opcodes undefined in 32-bit mode
+	for (const int op : { 0x04, 0x0A, 0x0C, 0x24, 0x25, 0x26, 0x27, 0x36, 0x39, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F, 0xA6, 0xA7 })
+		t[op] = { 0, 0, 1, 0, NONE, I::OTHER, O::OTHER };
+
+	return t;
+}
+
+inline constexpr std::array<OpcodeInfo, 256> OneByteOpcodes = makeOneByteOpcodes();
+inline constexpr std::array<OpcodeInfo, 256> TwoByteOpcodes = makeTwoByteOpcodes();
+
+static_assert(sizeof(OpcodeInfo) == 4);
+static_assert(OneByteOpcodes[0x66].prefix && OneByteOpcodes[0xE8].type == INSTRUCTION_TYPE::CALL);
+static_assert(TwoByteOpcodes[0x85].imm == IMM_TYPE::IZ && TwoByteOpcodes[0x38].modrm);
+
+#endif
@@ -0,0 +1,116 @@
+#include "patch_overlay.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+PatchOverlay::PatchOverlay(uint8_t*& image) :
+    image(image)
+{
+}
+
+std::vector<PatchOverlay::Patch>::const_iterator PatchOverlay::First(uint32_t addr) const
+{
+    return std::partition_point(patches.begin(), patches.begin() + sealed, [addr](const Patch& patch) { return patch.address + patch.size <= addr; });
+}
+
+void PatchOverlay::Write(uint32_t addr, std::span<const uint8_t> bytes)
+{
+    // Writing in address order keeps the overlay sealed for free
+    const bool in_order = sealed == patches.size() && (patches.empty() || addr >= patches.back().address + patches.back().size);
+    patches.push_back({ addr, static_cast<uint32_t>(pool.size()), static_cast<uint32_t>(bytes.size()) });
+    pool.insert(pool.end(), bytes.begin(), bytes.end());
+    if (in_order)
+        sealed++;
+}
+
+void PatchOverlay::Seal()
+{
+    if (sealed == patches.size())
+        return;
+
+    // Each run of overlapping patches becomes one, written again over the image in the order
+    // the patches were written, which is the order of their bytes in the pool
+    std::ranges::sort(patches, {}, &Patch::address);
+    std::vector<Patch> merged;
+    merged.reserve(patches.size());
+    std::vector<uint8_t> bytes;
+    for (size_t first = 0, last; first < patches.size(); first = last) {
+        uint32_t end = patches[first].address + patches[first].size;
+        for (last = first + 1; last < patches.size() && patches[last].address < end; last++)
+            end = std::max(end, patches[last].address + patches[last].size);
+        if (last - first == 1) {
+            merged.push_back(patches[first]);
+            continue;
+        }
+
+        const uint32_t start = patches[first].address;
+        std::sort(patches.begin() + first, patches.begin() + last, [](const Patch& a, const Patch& b) { return a.offset < b.offset; });
+        bytes.assign(image + start, image + end);
+        for (size_t i = first; i < last; i++)
+            std::copy_n(pool.begin() + patches[i].offset, patches[i].size, bytes.begin() + (patches[i].address - start));
+        merged.push_back({ start, static_cast<uint32_t>(pool.size()), end - start });
+        pool.insert(pool.end(), bytes.begin(), bytes.end());
+    }
+    patches = std::move(merged);
+    sealed = patches.size();
+}
+
+void PatchOverlay::Read(uint32_t addr, std::span<uint8_t> out) const
+{
+    std::copy_n(image + addr, out.size(), out.begin());
+    const uint64_t end = static_cast<uint64_t>(addr) + out.size();
+    const auto apply = [&](const Patch& patch) {
+        const uint32_t from = std::max(patch.address, addr);
+        const uint32_t to = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(patch.address) + patch.size, end));
+        if (from < to)
+            std::copy(pool.begin() + patch.offset + (from - patch.address), pool.begin() + patch.offset + (to - patch.address), out.begin() + (from - addr));
+    };
+    const auto unsealed = patches.begin() + sealed;
+    for (auto it = First(addr); it != unsealed && it->address < end; ++it)
+        apply(*it);
+
+    // What was written out of order since the last Seal() goes on top, in write order
+    for (auto it = unsealed; it != patches.end(); ++it)
+        apply(*it);
+}
+
+std::span<const uint8_t> PatchOverlay::View(uint32_t addr, size_t size) const
+{
+    // The last patch written over the range has its bytes, if it covers all of it
+    for (auto it = patches.end(); it != patches.begin() + sealed;) {
+        --it;
+        if (it->address >= addr + size || addr >= it->address + it->size)
+            continue;
+        if (it->address > addr || addr + size > it->address + it->size)
+            throw std::logic_error("Read straddles the edge of a patch.");
+        return { pool.data() + it->offset + (addr - it->address), size };
+    }
+
+    const auto it = First(addr);
+    if (it == patches.begin() + sealed || it->address >= addr + size)
+        return { image + addr, size };
+    if (it->address > addr || addr + size > it->address + it->size)
+        throw std::logic_error("Read straddles the edge of a patch.");
+    return { pool.data() + it->offset + (addr - it->address), size };
+}
+
+bool PatchOverlay::Overlaps(uint32_t addr, size_t size) const
+{
+    const auto it = First(addr);
+    if (it != patches.begin() + sealed && it->address < addr + size)
+        return true;
+    return std::any_of(patches.begin() + sealed, patches.end(),
+        [&](const Patch& patch) { return patch.address < addr + size && addr < patch.address + patch.size; });
+}
+
+void PatchOverlay::Clear()
+{
+    patches.clear();
+    pool.clear();
+    sealed = 0;
+}
+
+bool PatchOverlay::Empty() const
+{
+    return patches.empty();
+}
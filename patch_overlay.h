@@ -0,0 +1,54 @@
+#pragma once
+
+#ifndef PATCH_OVERLAY_H
+#define PATCH_OVERLAY_H
+
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// Edits to the virtual image that haven't been written to it yet. Patches are
+// sorted by address with their bytes in a single pool, and never overlap: patches
+// written over each other merge. Reads see the patches over the image, so a variant
+// costs only its patched bytes, and dropping it costs nothing.
+// Write() appends. Patches written out of address order are read on top of the
+// sorted ones until Seal() sorts and merges them all in one pass, so a batch of
+// edits costs a sort rather than an insertion each.
+class PatchOverlay
+{
+public:
+	explicit PatchOverlay(uint8_t*& image);
+
+	void Write(uint32_t addr, std::span<const uint8_t> bytes);
+	void Seal();
+	void Read(uint32_t addr, std::span<uint8_t> out) const;
+	std::span<const uint8_t> View(uint32_t addr, size_t size) const; // the range can't straddle the edge of a patch
+	bool Overlaps(uint32_t addr, size_t size) const;
+	void Clear();
+	bool Empty() const;
+
+	// Visits every patch as (address, bytes), in address order once sealed and in write order after that
+	template <typename F>
+	void ForEach(F&& visit) const
+	{
+		for (const Patch& patch : patches)
+			visit(patch.address, std::span<const uint8_t>(pool.data() + patch.offset, patch.size));
+	}
+private:
+	struct Patch
+	{
+		uint32_t address;
+		uint32_t offset; // into pool
+		uint32_t size;
+	};
+
+	std::vector<Patch>::const_iterator First(uint32_t addr) const; // first sealed patch ending after addr
+
+	uint8_t*& image;
+	std::vector<Patch> patches;
+	std::vector<uint8_t> pool; // in write order; bytes of merged patches stay behind until Clear()
+	size_t sealed{}; // leading patches that are sorted and don't overlap
+};
+
+#endif
@@ -0,0 +1,230 @@
+#include "register_values.h"
+
+#include <algorithm>
+#include <deque>
+#include <utility>
+
+#include "disassembler.h"
+
+namespace
+{
+    // Little-endian, sign-extended to 32 bits
+    uint32_t readImmediate(std::span<const uint8_t> bytes, uint8_t offset, uint8_t size)
+    {
+        uint32_t value = 0;
+        for (uint8_t i = 0; i < size; i++)
+            value |= static_cast<uint32_t>(bytes[offset + i]) << (8 * i);
+        if (size && size < 4 && (value >> (8 * size - 1) & 1))
+            value |= UINT32_MAX << (8 * size);
+        return value;
+    }
+
+    // Operation in the encoding of ADD/OR/ADC/SBB/AND/SUB/XOR/CMP; the carry ones and CMP give nothing
+    bool compute(uint8_t operation, uint32_t left, uint32_t right, uint32_t& result)
+    {
+        switch (operation) {
+        case 0: result = left + right; return true;
+        case 1: result = left | right; return true;
+        case 4: result = left & right; return true;
+        case 5: result = left - right; return true;
+        case 6: result = left ^ right; return true;
+        default: return false;
+        }
+    }
+
+    // The value an instruction gives its destination register, when the known registers are enough to work it out
+    bool evaluate(const DecodedInstruction& decoded, std::span<const uint8_t> bytes, const RegisterState& registers, uint8_t& target, uint32_t& value)
+    {
+        if (decoded.map != MAP_ONE_BYTE || decoded.prefixes & (PREFIX_OPERAND_SIZE | PREFIX_ADDRESS_SIZE | PREFIX_LOCK))
+            return false;
+        const uint8_t op = decoded.opcode, mod = getMod(decoded.modrm), reg = getReg(decoded.modrm), rm = getRM(decoded.modrm);
+        const auto known = [&registers](uint8_t r) { return registers[r].is_value_known; };
+        const auto get = [&registers](uint8_t r) { return static_cast<uint32_t>(registers[r].value); };
+        const uint32_t imm = readImmediate(bytes, decoded.immOffset, decoded.immSize);
+
+        if (op >= 0xB8 && op <= 0xBF) { // MOV r32, imm32
+            target = op & 7;
+            value = imm;
+            return true;
+        }
+        if (op >= 0x40 && op <= 0x4F) { // INC/DEC r32
+            target = op & 7;
+            value = get(target) + (op < 0x48 ? 1 : UINT32_MAX);
+            return known(target);
+        }
+        if (op < 0x40 && (op & 7) == 5) { // operation on EAX with imm32
+            target = static_cast<uint8_t>(REGISTER::EAX);
+            return known(target) && compute(op >> 3, get(target), imm, value);
+        }
+        if (op < 0x40 && ((op & 7) == 1 || (op & 7) == 3) && mod == 3) { // operation on two registers
+            target = op & 2 ? reg : rm;
+            const uint8_t source = op & 2 ? rm : reg;
+            if (reg == rm && ((op >> 3) == 5 || (op >> 3) == 6)) { // SUB/XOR of a register with itself
+                value = 0;
+                return true;
+            }
+            return known(target) && known(source) && compute(op >> 3, get(target), get(source), value);
+        }
+
+        switch (op) {
+        case 0x81: case 0x83: // operation on a register with an immediate
+            target = rm;
+            return mod == 3 && known(rm) && compute(reg, get(rm), imm, value);
+        case 0x89: case 0x8B: { // MOV r32, r32
+            target = op == 0x89 ? rm : reg;
+            const uint8_t source = op == 0x89 ? reg : rm;
+            value = get(source);
+            return mod == 3 && known(source);
+        }
+        case 0x8D: { // LEA
+            if (mod == 3)
+                return false;
+            target = reg;
+            value = readImmediate(bytes, decoded.dispOffset, decoded.dispSize);
+            if (decoded.hasSib) {
+                const uint8_t base = getRM(decoded.sib), index = getReg(decoded.sib);
+                if (!(mod == 0 && base == 5)) {
+                    if (!known(base))
+                        return false;
+                    value += get(base);
+                }
+                if (index != 4) {
+                    if (!known(index))
+                        return false;
+                    value += get(index) << getMod(decoded.sib);
+                }
+            }
+            else if (!(mod == 0 && rm == 5)) {
+                if (!known(rm))
+                    return false;
+                value += get(rm);
+            }
+            return true;
+        }
+        }
+        return false;
+    }
+}
+
+void RegisterValues::Build(const BlockGraph& blocks, const InstructionStore& code, std::span<const uint32_t> entries)
+{
+    Clear();
+    Update(blocks, code, {}, entries);
+}
+
+void RegisterValues::Update(const BlockGraph& blocks, const InstructionStore& code, std::span<const uint32_t> changed, std::span<const uint32_t> entries)
+{
+    // New blocks are changed too; a full build sees every block
+    const size_t count = blocks.Size(), known = exits.size();
+    exits.resize(count);
+    reached.resize(count);
+    external.resize(count);
+    std::vector<uint32_t> seeds;
+    if (!known)
+        seeds = blocks.ReversePostOrder();
+    else {
+        seeds.assign(changed.begin(), changed.end());
+        for (uint32_t id = static_cast<uint32_t>(known); id < count; id++)
+            seeds.push_back(id);
+    }
+    for (const uint32_t id : seeds)
+        external[id] = false;
+    for (const uint32_t id : entries)
+        external[id] = true;
+
+    // Everything the changed blocks flow into is solved again from nothing: stale states
+    // going around a loop that lost its entry would otherwise keep counting
+    if (known) {
+        seeds = blocks.Closure(seeds, true);
+        for (const uint32_t id : seeds)
+            reached[id] = false;
+    }
+    Propagate(blocks, code, seeds);
+}
+
+void RegisterValues::Propagate(const BlockGraph& blocks, const InstructionStore& code, std::span<const uint32_t> seeds)
+{
+    // A block contributes nothing to the meet of its successors until something flowed through it
+    std::vector<bool> queued(blocks.Size());
+    std::deque<uint32_t> worklist;
+    for (const uint32_t id : seeds) {
+        if (!queued[id]) {
+            queued[id] = true;
+            worklist.push_back(id);
+        }
+    }
+
+    while (!worklist.empty()) {
+        const uint32_t id = worklist.front();
+        worklist.pop_front();
+        queued[id] = false;
+
+        // Nothing is known entering a block without predecessors or reached from outside the graph
+        RegisterState registers{};
+        bool entered = blocks.Predecessors(id).empty() || external[id];
+        for (const uint32_t predecessor : external[id] ? std::span<const uint32_t>{} : blocks.Predecessors(id)) {
+            if (!reached[predecessor])
+                continue;
+            if (!entered)
+                registers = exits[predecessor];
+            else
+                Meet(registers, exits[predecessor]);
+            entered = true;
+        }
+        if (!entered)
+            continue;
+        for (BlockRegister& reg : registers) {
+            reg.modified = false;
+            reg.inherited_value = reg.is_value_known;
+        }
+
+        Transfer(code, blocks[id], registers);
+        if (reached[id] && registers == exits[id])
+            continue;
+        reached[id] = true;
+        exits[id] = registers;
+        for (const uint32_t successor : blocks.Successors(id)) {
+            if (!queued[successor]) {
+                queued[successor] = true;
+                worklist.push_back(successor);
+            }
+        }
+    }
+}
+
+void RegisterValues::Clear()
+{
+    exits.clear();
+    reached.clear();
+    external.clear();
+}
+
+const RegisterState& RegisterValues::AtExit(uint32_t id) const
+{
+    static const RegisterState unknown{};
+    return id < exits.size() ? exits[id] : unknown;
+}
+
+void RegisterValues::Transfer(const InstructionStore& code, const Block& block, RegisterState& registers)
+{
+    for (auto it = code.lowerBound(block.start_address); it != code.end() && code.getAddress(it.getIndex()) < block.end_address; ++it) {
+        const InstructionStore::Instruction instruction = *it;
+        uint8_t target;
+        uint32_t value;
+        const bool known = evaluate(instruction.decoded, instruction.bytes, registers, target, value);
+
+        // Anything else the instruction writes is no longer known
+        for (uint8_t reg = 0; reg < registers.size(); reg++)
+            if (instruction.decoded.regsWritten >> reg & 1)
+                registers[reg] = { 0, true, false, false };
+        if (known)
+            registers[target] = { static_cast<int32_t>(value), true, true, false };
+    }
+}
+
+void RegisterValues::Meet(RegisterState& registers, const RegisterState& incoming)
+{
+    for (size_t reg = 0; reg < registers.size(); reg++)
+        if (registers[reg].is_value_known && (!incoming[reg].is_value_known || incoming[reg].value != registers[reg].value))
+            registers[reg] = {};
+}
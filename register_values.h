@@ -0,0 +1,54 @@
+#pragma once
+
+#ifndef REGISTER_VALUES_H
+#define REGISTER_VALUES_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "block_graph.h"
+
+class InstructionStore;
+
+struct BlockRegister
+{
+	int32_t value{ NULL };
+	bool modified{ false };
+	bool is_value_known = false;
+	bool inherited_value = false;
+
+	bool operator == (const BlockRegister&) const = default;
+};
+
+using RegisterState = std::array<BlockRegister, 8>; // by REGISTER
+
+// Forward constant propagation of the general purpose registers over a block graph.
+// Blocks are visited from a worklist, in reverse post-order for a full build, and
+// a block is only queued again when the state leaving one of its predecessors
+// changes. A register can only go from known to unknown once, so this converges
+// in a handful of visits per block. The state at the end of every block is kept,
+// so queries cost a lookup. Blocks entered from outside the graph (the entry
+// point, call targets, code whose address is taken) start with every register
+// unknown. Update() only solves the blocks an edit changed and the blocks they
+// lead to again.
+class RegisterValues
+{
+public:
+	void Build(const BlockGraph& blocks, const InstructionStore& code, std::span<const uint32_t> entries);
+	void Update(const BlockGraph& blocks, const InstructionStore& code, std::span<const uint32_t> changed, std::span<const uint32_t> entries); // entries: the changed blocks entered from outside
+	void Clear();
+	const RegisterState& AtExit(uint32_t id) const; // every register unknown for blocks Build() didn't see
+	static void Transfer(const InstructionStore& code, const Block& block, RegisterState& registers);
+private:
+	void Propagate(const BlockGraph& blocks, const InstructionStore& code, std::span<const uint32_t> seeds);
+	static void Meet(RegisterState& registers, const RegisterState& incoming);
+
+	std::vector<RegisterState> exits; // by block id
+	std::vector<bool> reached; // something flowed through the block
+	std::vector<bool> external; // entered from outside the graph
+};
+
+#endif
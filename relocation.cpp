@@ -0,0 +1,88 @@
+#include "relocation.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+RelocationTable::RelocationTable(const uint8_t* image, size_t image_size, uint32_t directory_rva, uint32_t directory_size) :
+    bitmap((image_size + 63) / 64), imageSize(image_size)
+{
+    // Check that the directory lies within the image
+    if (static_cast<size_t>(directory_rva) + directory_size > image_size)
+        throw std::runtime_error("Relocation directory out of bounds.");
+
+    const uint8_t* cursor = image + directory_rva;
+    const uint8_t* const end = cursor + directory_size;
+
+    // Walk each block: a RelocationChunk header followed by 16-bit entries
+    while (end - cursor >= static_cast<ptrdiff_t>(sizeof(RelocationChunk))) {
+        RelocationChunk chunk;
+        std::memcpy(&chunk, cursor, sizeof(chunk));
+        // Linkers pad the directory with zeros after the last block
+        if (chunk.size_chunk < sizeof(RelocationChunk))
+            break;
+        if (chunk.size_chunk > static_cast<size_t>(end - cursor))
+            throw std::runtime_error("Invalid relocation block.");
+
+        const size_t count = (chunk.size_chunk - sizeof(RelocationChunk)) / sizeof(Relocation);
+        const uint8_t* entries = cursor + sizeof(RelocationChunk);
+        for (size_t i = 0; i < count; i++) {
+            Relocation entry;
+            std::memcpy(&entry, entries + i * sizeof(Relocation), sizeof(entry));
+            const uint32_t rva = chunk.virtual_address + entry.offset;
+
+            switch (entry.type) {
+            case IIMAGE_REL_BASED_HIGHLOW:
+                Mark(rva, 4);
+                break;
+            case IIMAGE_REL_BASED_HIGHADJ:
+                // The low half of the adjustment is stored in the next entry
+                i++;
+                [[fallthrough]];
+            case IIMAGE_REL_BASED_HIGH:
+            case IIMAGE_REL_BASE_LOW:
+                Mark(rva, 2);
+                break;
+            default:
+                // IIMAGE_REL_BASED_ABSOLUTE is padding; other types don't apply to i386
+                break;
+            }
+        }
+        cursor += chunk.size_chunk;
+    }
+
+    // Blocks are usually emitted in order, but nothing requires it
+    if (!std::ranges::is_sorted(addresses))
+        std::ranges::sort(addresses);
+}
+
+std::span<const uint32_t> RelocationTable::GetRelocatedAddresses() const
+{
+    return addresses;
+}
+
+bool RelocationTable::IsRelocated(uint32_t rva, size_t size) const
+{
+    // Test the bits covering [rva, rva + size), a word at a time
+    size_t first = rva;
+    const size_t last = std::min(first + size, imageSize);
+    while (first < last) {
+        const size_t bits = std::min<size_t>(last - first, 64 - first % 64);
+        const uint64_t mask = (bits == 64 ? ~0ull : (1ull << bits) - 1) << (first % 64);
+        if (bitmap[first / 64] & mask)
+            return true;
+        first += bits;
+    }
+    return false;
+}
+
+void RelocationTable::Mark(uint32_t rva, size_t size)
+{
+    // Ignore fixups pointing outside of the image
+    if (static_cast<size_t>(rva) + size > imageSize)
+        return;
+
+    addresses.push_back(rva);
+    for (size_t i = rva; i < rva + size; i++)
+        bitmap[i / 64] |= 1ull << (i % 64);
+}
@@ -1,5 +1,8 @@
 #pragma once
 #include <cstdint>
+#include <cstddef>
+#include <span>
+#include <vector>
 
 enum RELOCATION_TYPE
 {
@@ -20,4 +23,23 @@ struct Relocation
 {
 	uint16_t offset : 12;
 	uint16_t type : 4;
-};
\ No newline at end of file
+};
+
+// Base relocations of an image, decoded once from the .reloc directory.
+// Keeps the sorted RVAs of every fixup plus a bit per byte of the image
+// covered by one, so "is this operand an absolute pointer?" is a bit test.
+class RelocationTable
+{
+public:
+	RelocationTable() = default;
+	RelocationTable(const uint8_t* image, size_t image_size, uint32_t directory_rva, uint32_t directory_size);
+
+	std::span<const uint32_t> GetRelocatedAddresses() const;
+	bool IsRelocated(uint32_t rva, size_t size = 1) const;
+private:
+	void Mark(uint32_t rva, size_t size);
+
+	std::vector<uint32_t> addresses; // sorted RVAs of the fixups
+	std::vector<uint64_t> bitmap; // bit set for every byte a fixup patches
+	size_t imageSize{};
+};
@@ -0,0 +1,65 @@
+#include "transform.h"
+#include "dependency_graph.h"
+
+Transform::Transform(Disassembler& disassembler, PEParser& parser, uint8_t rand) :
+    disasm(disassembler), parser(parser), rand(rand), random(std::random_device{}())
+{
+}
+
+unsigned Transform::shuffle()
+{
+    // Runs of movable instructions are cut at pinned ones, at 64 instructions and before
+    // any address control can arrive at from elsewhere; each run takes a random order
+    // allowed by its dependency graph
+    const InstructionStore& code = disasm.getCode();
+    const BlockGraph& blocks = disasm.getBlocks();
+    DependencyGraph graph;
+    std::vector<uint32_t> order;
+    unsigned shuffled = 0;
+    for (uint32_t id = 0; id < blocks.Size(); id++) {
+        const size_t last = code.lowerBound(blocks[id].end_address).getIndex();
+        size_t first = code.lowerBound(blocks[id].start_address).getIndex();
+        for (size_t i = first; i <= last; i++) {
+            const bool pinned = i == last || !is_movable(i);
+            if (!pinned && i - first < DependencyGraph::MaxSize && (i == first || !disasm.hasCrossRefs(code.getAddress(i))))
+                continue;
+            if (i - first > 1 && get_rand_bool()) {
+                // Flags nobody in the run reads and that are dead after it don't order anything
+                RegisterMask flagsRead = 0;
+                for (size_t j = first; j < i; j++)
+                    flagsRead |= getReadMask(code.getDecoded(j));
+                const bool flagsFree = !(flagsRead & MaskFlags) && is_dead(code.getAddress(i - 1), MaskFlags);
+                graph.Build(code, first, i - first, flagsFree ? MaskFlags : 0);
+                graph.Sample(random, order);
+                if (!std::ranges::is_sorted(order)) {
+                    disasm.reorderInstructions(code.getAddress(first), order);
+                    shuffled++;
+                }
+            }
+            first = pinned ? i + 1 : i;
+        }
+    }
+    if (shuffled)
+        disasm.reanalyze();
+    return shuffled;
+}
+
+bool Transform::get_rand_bool()
+{
+    return std::uniform_int_distribution<int>(1, 100)(random) <= rand;
+}
+
+bool Transform::is_dead(uint32_t addr, RegisterMask mask) const
+{
+    return !(disasm.getLiveAfter(addr) & mask);
+}
+
+bool Transform::is_movable(size_t index) const
+{
+    // Branches and relocated operands depend on where they are; the rest needs all its effects in the masks
+    const InstructionStore& code = disasm.getCode();
+    const DecodedInstruction& decoded = code.getDecoded(index);
+    if (decoded.type != INSTRUCTION_TYPE::OTHER && decoded.type != INSTRUCTION_TYPE::NOP && decoded.type != INSTRUCTION_TYPE::STACK)
+        return false;
+    return !parser.IsRelocated(code.getAddress(index), decoded.length) && DependencyGraph::IsModelled(decoded);
+}
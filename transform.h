@@ -1,4 +1,5 @@
 #pragma once
+#include <random>
 #include "disassembler.h"
 
 class Transform
@@ -10,8 +11,11 @@ public:
 	unsigned short encrypt_section(std::string section_name);
 protected:
 	bool get_rand_bool();
+	bool is_dead(uint32_t addr, RegisterMask mask) const; // nothing in mask is read after addr before being written
+	bool is_movable(size_t index) const; // the instruction keeps its meaning at any address in its block
 private:
 	Disassembler& disasm;
 	PEParser& parser;
 	uint8_t rand;
+	std::mt19937 random;
 };
@@ -0,0 +1,56 @@
+#include "work_queue.h"
+
+#include <thread>
+
+WorkQueue::WorkQueue(size_t workers) :
+    deques(std::make_unique<Deque[]>(workers)), workers(workers)
+{
+}
+
+void WorkQueue::Push(size_t worker, uint32_t addr)
+{
+    // Count the target before it can be stolen, so the count never drops to zero early
+    outstanding.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard guard(deques[worker].lock);
+    deques[worker].targets.push_back(addr);
+}
+
+bool WorkQueue::Pop(size_t worker, uint32_t& addr)
+{
+    for (;;) {
+        {
+            // Newest target first: it's likely next to what was just decoded
+            std::lock_guard guard(deques[worker].lock);
+            if (!deques[worker].targets.empty()) {
+                addr = deques[worker].targets.back();
+                deques[worker].targets.pop_back();
+                return true;
+            }
+        }
+        if (Steal(worker, addr))
+            return true;
+        if (!outstanding.load(std::memory_order_acquire))
+            return false;
+        std::this_thread::yield();
+    }
+}
+
+bool WorkQueue::Steal(size_t worker, uint32_t& addr)
+{
+    // Oldest target of the first other worker that has one
+    for (size_t i = 1; i < workers; i++) {
+        Deque& victim = deques[(worker + i) % workers];
+        std::lock_guard guard(victim.lock);
+        if (!victim.targets.empty()) {
+            addr = victim.targets.front();
+            victim.targets.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkQueue::Done()
+{
+    outstanding.fetch_sub(1, std::memory_order_release);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+// Branch targets shared by the analysis threads.
+// Each worker pushes and pops at the back of its own deque, and steals from the
+// front of the others when it runs dry. The work is over once no target is
+// queued or still being followed.
+class WorkQueue
+{
+public:
+	explicit WorkQueue(size_t workers);
+
+	void Push(size_t worker, uint32_t addr);
+	bool Pop(size_t worker, uint32_t& addr); // false once all the work is done
+	void Done(); // the target returned by the last Pop has been followed
+private:
+	bool Steal(size_t worker, uint32_t& addr);
+
+	struct alignas(64) Deque
+	{
+		std::mutex lock;
+		std::deque<uint32_t> targets;
+	};
+
+	std::unique_ptr<Deque[]> deques;
+	size_t workers;
+	std::atomic<size_t> outstanding{}; // targets queued or being followed
+};
+
+#endif
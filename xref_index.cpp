@@ -0,0 +1,223 @@
+#include "xref_index.h"
+
+#include <algorithm>
+
+#include "disassembler.h"
+
+template <typename T, typename Key>
+void XrefIndex::RadixSort(std::vector<T>& items, Key key)
+{
+    // Stable LSD sort on 32-bit keys, 16 bits per pass
+    std::vector<T> buffer(items.size());
+    for (unsigned shift = 0; shift < 32; shift += 16) {
+        std::vector<uint32_t> counts(0x10001);
+        for (const T& item : items)
+            counts[(key(item) >> shift & 0xFFFF) + 1]++;
+        for (size_t i = 1; i < counts.size(); i++)
+            counts[i] += counts[i - 1];
+        for (const T& item : items)
+            buffer[counts[key(item) >> shift & 0xFFFF]++] = item;
+        items.swap(buffer);
+    }
+}
+
+template <typename T>
+void XrefIndex::Append(Rows& rows, std::vector<T>& values, uint32_t key, const T& value)
+{
+    // A row that isn't the last one of the array moves to its end, leaving a hole behind
+    const size_t row = rows.Row(key);
+    const uint32_t first = rows.firsts[row], count = rows.counts[row];
+    if (first + count != values.size()) {
+        rows.firsts[row] = static_cast<uint32_t>(values.size());
+        values.reserve(values.size() + count + 1);
+        for (uint32_t i = 0; i < count; i++)
+            values.push_back(values[first + i]);
+    }
+    values.push_back(value);
+    rows.counts[row]++;
+}
+
+void XrefIndex::Rows::Build(std::span<const uint32_t> sorted_keys)
+{
+    keys.clear();
+    firsts.clear();
+    counts.clear();
+    for (size_t i = 0; i < sorted_keys.size(); i++) {
+        if (keys.empty() || keys.back() != sorted_keys[i]) {
+            keys.push_back(sorted_keys[i]);
+            firsts.push_back(static_cast<uint32_t>(i));
+            counts.push_back(0);
+        }
+        counts.back()++;
+    }
+}
+
+std::pair<size_t, size_t> XrefIndex::Rows::Find(uint32_t key) const
+{
+    const auto it = std::ranges::lower_bound(keys, key);
+    if (it == keys.end() || *it != key)
+        return { 0, 0 };
+    const size_t row = it - keys.begin();
+    return { firsts[row], firsts[row] + counts[row] };
+}
+
+size_t XrefIndex::Rows::Row(uint32_t key)
+{
+    const auto it = std::ranges::lower_bound(keys, key);
+    const size_t row = it - keys.begin();
+    if (it == keys.end() || *it != key) {
+        keys.insert(it, key);
+        firsts.insert(firsts.begin() + row, 0);
+        counts.insert(counts.begin() + row, 0);
+    }
+    return row;
+}
+
+void XrefIndex::Build(std::span<const Branch> branches, std::span<const std::pair<uint32_t, uint32_t>> references, uint32_t start, uint32_t end)
+{
+    this->start = start;
+    this->end = end;
+    referenced.assign((static_cast<size_t>(end - start) + 63) / 64, 0);
+
+    forward.assign(branches.begin(), branches.end());
+    RadixSort(forward, [](const Branch& branch) { return branch.source; });
+    reverse = forward;
+    RadixSort(reverse, [](const Branch& branch) { return branch.dest; });
+
+    std::vector<std::pair<uint32_t, uint32_t>> sorted_references(references.begin(), references.end());
+    RadixSort(sorted_references, [](const std::pair<uint32_t, uint32_t>& reference) { return reference.first; });
+
+    std::vector<uint32_t> keys(forward.size());
+    std::ranges::transform(forward, keys.begin(), &Branch::source);
+    forwardRows.Build(keys);
+    std::ranges::transform(reverse, keys.begin(), &Branch::dest);
+    reverseRows.Build(keys);
+
+    keys.resize(sorted_references.size());
+    referenceSources.resize(sorted_references.size());
+    for (size_t i = 0; i < sorted_references.size(); i++) {
+        keys[i] = sorted_references[i].first;
+        referenceSources[i] = sorted_references[i].second;
+    }
+    referenceRows.Build(keys);
+
+    // The same references by source, so an edited instruction can drop its own
+    RadixSort(sorted_references, [](const std::pair<uint32_t, uint32_t>& reference) { return reference.second; });
+    referenceDests.resize(sorted_references.size());
+    for (size_t i = 0; i < sorted_references.size(); i++) {
+        keys[i] = sorted_references[i].second;
+        referenceDests[i] = sorted_references[i].first;
+    }
+    referenceFromRows.Build(keys);
+
+    // Indirect branches have no destination to mark
+    for (const uint32_t dest : reverseRows.keys)
+        Mark(dest);
+    for (const uint32_t dest : referenceRows.keys)
+        Mark(dest);
+}
+
+void XrefIndex::Clear()
+{
+    forward.clear();
+    reverse.clear();
+    referenceSources.clear();
+    referenceDests.clear();
+    forwardRows = {};
+    reverseRows = {};
+    referenceRows = {};
+    referenceFromRows = {};
+    referenced.clear();
+    start = end = 0;
+}
+
+void XrefIndex::AddBranch(const Branch& branch)
+{
+    Append(forwardRows, forward, branch.source, branch);
+    Append(reverseRows, reverse, branch.dest, branch);
+    Mark(branch.dest);
+}
+
+void XrefIndex::AddReference(uint32_t dest, uint32_t source)
+{
+    Append(referenceRows, referenceSources, dest, source);
+    Append(referenceFromRows, referenceDests, source, dest);
+    Mark(dest);
+}
+
+void XrefIndex::RemoveBranchesFrom(uint32_t source)
+{
+    const auto [first, last] = forwardRows.Find(source);
+    if (first == last)
+        return;
+
+    // Rows shrink in place; empty ones stay until the next Build()
+    for (size_t i = first; i < last; i++) {
+        const uint32_t dest = forward[i].dest;
+        const size_t row = reverseRows.Row(dest);
+        const auto begin = reverse.begin() + reverseRows.firsts[row];
+        const auto end = std::remove_if(begin, begin + reverseRows.counts[row], [source](const Branch& branch) { return branch.source == source; });
+        reverseRows.counts[row] = static_cast<uint32_t>(end - begin);
+        if (!reverseRows.counts[row] && ReferencesTo(dest).empty())
+            Unmark(dest);
+    }
+    forwardRows.counts[forwardRows.Row(source)] = 0;
+}
+
+void XrefIndex::RemoveReferencesFrom(uint32_t source)
+{
+    const auto [first, last] = referenceFromRows.Find(source);
+    if (first == last)
+        return;
+
+    // Same as the branches; a destination stays marked while a branch still goes there
+    for (size_t i = first; i < last; i++) {
+        const uint32_t dest = referenceDests[i];
+        const size_t row = referenceRows.Row(dest);
+        const auto begin = referenceSources.begin() + referenceRows.firsts[row];
+        const auto end = std::remove(begin, begin + referenceRows.counts[row], source);
+        referenceRows.counts[row] = static_cast<uint32_t>(end - begin);
+        if (!referenceRows.counts[row] && BranchesTo(dest).empty())
+            Unmark(dest);
+    }
+    referenceFromRows.counts[referenceFromRows.Row(source)] = 0;
+}
+
+void XrefIndex::Mark(uint32_t dest)
+{
+    if (dest >= start && dest < end)
+        referenced[(dest - start) / 64] |= uint64_t{ 1 } << ((dest - start) % 64);
+}
+
+void XrefIndex::Unmark(uint32_t dest)
+{
+    if (dest >= start && dest < end)
+        referenced[(dest - start) / 64] &= ~(uint64_t{ 1 } << ((dest - start) % 64));
+}
+
+std::span<const Branch> XrefIndex::BranchesFrom(uint32_t source) const
+{
+    const auto [first, last] = forwardRows.Find(source);
+    return std::span(forward).subspan(first, last - first);
+}
+
+std::span<const Branch> XrefIndex::BranchesTo(uint32_t dest) const
+{
+    if (!IsReferenced(dest))
+        return {};
+    const auto [first, last] = reverseRows.Find(dest);
+    return std::span(reverse).subspan(first, last - first);
+}
+
+std::span<const uint32_t> XrefIndex::ReferencesTo(uint32_t dest) const
+{
+    if (!IsReferenced(dest))
+        return {};
+    const auto [first, last] = referenceRows.Find(dest);
+    return std::span(referenceSources).subspan(first, last - first);
+}
+
+bool XrefIndex::IsReferenced(uint32_t dest) const
+{
+    return dest >= start && dest < end && referenced[(dest - start) / 64] >> ((dest - start) % 64) & 1;
+}
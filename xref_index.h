@@ -0,0 +1,67 @@
+#pragma once
+
+#ifndef XREF_INDEX_H
+#define XREF_INDEX_H
+
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <utility>
+#include <vector>
+
+struct Branch;
+
+// Cross references of the analysed code, built once when the analysis is done.
+// Edges are radix sorted into compressed sparse rows, one row per address, in
+// both directions; queries return spans into the rows without allocating.
+// A bit per byte of the code bounds says whether anything refers to it.
+// After an edit, rows are patched in place or moved to the end of their
+// array when they grow, so updating an edge never rebuilds the index.
+class XrefIndex
+{
+public:
+	void Build(std::span<const Branch> branches, std::span<const std::pair<uint32_t, uint32_t>> references, uint32_t start, uint32_t end);
+	void Clear();
+	void AddBranch(const Branch& branch);
+	void AddReference(uint32_t dest, uint32_t source);
+	void RemoveBranchesFrom(uint32_t source);
+	void RemoveReferencesFrom(uint32_t source);
+
+	std::span<const Branch> BranchesFrom(uint32_t source) const;
+	std::span<const Branch> BranchesTo(uint32_t dest) const;
+	std::span<const uint32_t> ReferencesTo(uint32_t dest) const; // sources of non-branch references
+	bool IsReferenced(uint32_t dest) const; // by a branch or a reference
+private:
+	// Row r holds the values at [firsts[r], firsts[r] + counts[r]) for the address keys[r]
+	struct Rows
+	{
+		std::vector<uint32_t> keys;
+		std::vector<uint32_t> firsts;
+		std::vector<uint32_t> counts;
+
+		void Build(std::span<const uint32_t> sorted_keys);
+		std::pair<size_t, size_t> Find(uint32_t key) const;
+		size_t Row(uint32_t key); // inserts an empty row if there is none
+	};
+
+	template <typename T, typename Key>
+	static void RadixSort(std::vector<T>& items, Key key);
+	template <typename T>
+	static void Append(Rows& rows, std::vector<T>& values, uint32_t key, const T& value);
+	void Mark(uint32_t dest);
+	void Unmark(uint32_t dest);
+
+	std::vector<Branch> forward; // by source
+	std::vector<Branch> reverse; // by destination
+	std::vector<uint32_t> referenceSources; // by destination
+	std::vector<uint32_t> referenceDests; // by source
+	Rows forwardRows;
+	Rows reverseRows;
+	Rows referenceRows;
+	Rows referenceFromRows;
+	std::vector<uint64_t> referenced; // bit per byte from start
+	uint32_t start{};
+	uint32_t end{};
+};
+
+#endif